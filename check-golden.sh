@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# Runs every .gba in ROMDIR through gbaflare-headless and compares its output
+# hash stream against ROMDIR/golden/<rom>.hashes. With --update the golden
+# files are (re)written instead. Each ROM is also recorded as a movie in
+# XRGB8888 with color correction and replayed in the default BGR555, which
+# must match since movie hashes do not depend on the output format. Extra
+# options go to gbaflare-headless.
+
+usage() {
+	echo "usage: $0 [--update] [--headless PATH] [--frames N] [--hash-interval N] ROMDIR [-- OPTIONS]" >&2
+	exit 2
+}
+
+headless=build/gbaflare-headless
+frames=600
+interval=60
+update=0
+romdir=
+
+while [ $# -gt 0 ]; do
+	case "$1" in
+		--update) update=1 ;;
+		--headless) headless="$2"; shift ;;
+		--frames) frames="$2"; shift ;;
+		--hash-interval) interval="$2"; shift ;;
+		--) shift; break ;;
+		-*) usage ;;
+		*) romdir="$1" ;;
+	esac
+	shift
+done
+
+[ -n "$romdir" ] || usage
+mkdir -p "$romdir/golden"
+
+movie=$(mktemp)
+trap 'rm -f "$movie"' EXIT
+
+failed=0
+for rom in "$romdir"/*.gba; do
+	[ -e "$rom" ] || continue
+	golden="$romdir/golden/$(basename "$rom" .gba).hashes"
+
+	if [ $update -eq 1 ]; then
+		mode=(--hashes "$golden")
+	elif [ -e "$golden" ]; then
+		mode=(--golden "$golden")
+	else
+		echo "MISSING $(basename "$rom")"
+		failed=1
+		continue
+	fi
+
+	if ! "$headless" --no-save --frames "$frames" --hash-interval "$interval" "${mode[@]}" "$@" "$rom" 2>/dev/null; then
+		echo "FAILED  $(basename "$rom")"
+		failed=1
+	elif [ $update -eq 0 ] && ! { "$headless" --no-save --frames "$frames" --output-format xrgb8888 --color-correction --record "$movie" "$@" "$rom" &&
+			"$headless" --no-save --replay "$movie" "$@" "$rom"; } 2>/dev/null; then
+		echo "FAILED  $(basename "$rom") (movie replay in another output format)"
+		failed=1
+	else
+		echo "ok      $(basename "$rom")"
+	fi
+done
+
+exit $failed
@@ -0,0 +1,11 @@
+#ifndef GBAFLARE_HASH_H
+#define GBAFLARE_HASH_H
+
+#include <common/types.h>
+
+#include <cstddef>
+
+/* xxHash64, used to fingerprint ROMs and emulator output */
+u64 xxhash64(const void *data, std::size_t len, u64 seed = 0);
+
+#endif
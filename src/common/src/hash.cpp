@@ -0,0 +1,81 @@
+#include <common/hash.h>
+
+static constexpr u64 PRIME64_1 = 0x9E37'79B1'85EB'CA87;
+static constexpr u64 PRIME64_2 = 0xC2B2'AE3D'27D4'EB4F;
+static constexpr u64 PRIME64_3 = 0x1656'67B1'9E37'79F9;
+static constexpr u64 PRIME64_4 = 0x85EB'CA77'C2B2'AE63;
+static constexpr u64 PRIME64_5 = 0x27D4'EB2F'1656'67C5;
+
+static inline u64 read64(const u8 *p)
+{
+	return (u64)readarr<u32>((u8 *)p, 4) << 32 | readarr<u32>((u8 *)p, 0);
+}
+
+static inline u64 xxh_round(u64 acc, u64 input)
+{
+	acc += input * PRIME64_2;
+	acc = std::rotl(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline u64 xxh_merge(u64 acc, u64 val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+u64 xxhash64(const void *data, std::size_t len, u64 seed)
+{
+	const u8 *p = (const u8 *)data;
+	const u8 *end = p + len;
+	u64 h;
+
+	if (len >= 32) {
+		u64 v1 = seed + PRIME64_1 + PRIME64_2;
+		u64 v2 = seed + PRIME64_2;
+		u64 v3 = seed;
+		u64 v4 = seed - PRIME64_1;
+
+		do {
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+
+		h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	} else {
+		h = seed + PRIME64_5;
+	}
+
+	h += len;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= xxh_round(0, read64(p));
+		h = std::rotl(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (end - p >= 4) {
+		h ^= (u64)readarr<u32>((u8 *)p, 0) * PRIME64_1;
+		h = std::rotl(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	for (; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = std::rotl(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -2,6 +2,8 @@
 #define GBAFLARE_APU_H
 
 #include <common/types.h>
+#include <gba/blip.h>
+#include <gba/channel.h>
 
 #define FIFO_SIZE 33
 
@@ -16,6 +18,11 @@
 #define PSG_LEFT_VOL_MASK BITMASK(3)
 #define PSG_LEFT_VOL_SHIFT 4
 
+#define AUDIO_LEFT 0
+#define AUDIO_RIGHT 1
+
+#define AUDIO_LOG_SIZE 1024
+
 enum soundcnt_l_flags {
 	SOUND1_RIGHT_ON = 0x100,
 	SOUND2_RIGHT_ON = 0x200,
@@ -60,20 +67,49 @@ struct FIFO {
 };
 
 
+/* a change in output level, t cycles after the start of the audio frame */
+struct AudioDelta {
+	u32 t;
+	s32 left;
+	s32 right;
+};
+
+/*
+ * The APU does not produce samples on a schedule. Whenever a FIFO pops, a
+ * PSG channel steps or a sound register changes, the change in output level
+ * is logged with its exact cycle. The log is mixed into the blip buffer in
+ * one pass when it fills up or the frame ends, and a frame's worth of
+ * host-rate samples is read out at VBlank.
+ */
 struct APU {
 	s8 fifo_v[NUM_FIFOS]{};
-	u32 channel_cycles{};
-	u32 sample_cycles{};
 	u32 frameseq_cycles{};
 	u32 frame_sequencer{};
-	u32 audio_buffer_index{};
+
+	u64 frame_start{};
+	int psg_levels[NUM_PSG_CHANNELS]{};
+	s32 output[2]{};
+
+	/* per-unit gains under the current sound registers, refreshed by update_output */
+	s32 fifo_gains[2][NUM_FIFOS]{};
+	s32 psg_gains[2][NUM_PSG_CHANNELS]{};
+
+	AudioDelta deltas[AUDIO_LOG_SIZE]{};
+	int num_deltas{};
+	BlipBuffer blip;
 
 	void reset();
 	void channel_step();
-	void step();
 	void on_timer_overflow(int i);
 	void on_write(addr_t addr, u8 old_value, u8 new_value);
 
+	void set_sample_rate(u32 rate);
+	void on_psg_step(int ch, u64 t, int level);
+	void update_output();
+	void add_delta(u64 t, s32 left, s32 right);
+	void flush_deltas();
+	int end_frame(s16 *out, int max_samples);
+
 	void clock_length();
 	void clock_sweep();
 	void clock_envelope();
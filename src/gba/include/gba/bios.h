@@ -0,0 +1,55 @@
+#ifndef GBAFLARE_BIOS_H
+#define GBAFLARE_BIOS_H
+
+#include <common/types.h>
+
+/* flags the user IRQ handler ORs in for IntrWait, mirrored at 0x03FFFFF8 */
+#define BIOS_IRQ_FLAGS 0x7FF8
+
+/* open bus value the real BIOS leaves behind after returning from a SWI */
+#define BIOS_SWI_RETURN_OPCODE 0xE3A02004
+
+/* rough cost of entering the BIOS, dispatching the call and returning */
+#define BIOS_CALL_CYCLES 40
+
+enum bios_calls {
+	SWI_SOFT_RESET = 0x00,
+	SWI_REGISTER_RAM_RESET = 0x01,
+	SWI_HALT = 0x02,
+	SWI_STOP = 0x03,
+	SWI_INTR_WAIT = 0x04,
+	SWI_VBLANK_INTR_WAIT = 0x05,
+	SWI_DIV = 0x06,
+	SWI_DIV_ARM = 0x07,
+	SWI_SQRT = 0x08,
+	SWI_ARCTAN = 0x09,
+	SWI_ARCTAN2 = 0x0A,
+	SWI_CPU_SET = 0x0B,
+	SWI_CPU_FAST_SET = 0x0C,
+	SWI_GET_BIOS_CHECKSUM = 0x0D,
+	SWI_BG_AFFINE_SET = 0x0E,
+	SWI_OBJ_AFFINE_SET = 0x0F,
+	SWI_BIT_UNPACK = 0x10,
+	SWI_LZ77_UNCOMP_WRAM = 0x11,
+	SWI_LZ77_UNCOMP_VRAM = 0x12,
+	SWI_HUFF_UNCOMP = 0x13,
+	SWI_RL_UNCOMP_WRAM = 0x14,
+	SWI_RL_UNCOMP_VRAM = 0x15,
+	SWI_DIFF8_UNFILTER_WRAM = 0x16,
+	SWI_DIFF8_UNFILTER_VRAM = 0x17,
+	SWI_DIFF16_UNFILTER = 0x18,
+	SWI_SOUND_BIAS = 0x19
+};
+
+/*
+ * High-level emulation of the BIOS calls. When enabled, SWIs that are
+ * implemented here are serviced natively instead of vectoring into BIOS ROM;
+ * everything else still runs the real BIOS code. Without a BIOS image a small
+ * stub with the exception vectors and the IRQ dispatcher is installed instead.
+ */
+extern bool hle_bios;
+
+void install_hle_bios();
+bool bios_call(u32 comment);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef GBAFLARE_BLIP_H
+#define GBAFLARE_BLIP_H
+
+#include <common/types.h>
+#include <platform/common/platform.h>
+
+#define CLOCK_RATE (16 * 1024 * 1024)
+
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_WIDTH 16
+#define BLIP_KERNEL_BITS 15
+#define BLIP_SAMPLE_BITS 7
+#define BLIP_BASS_SHIFT 9
+#define BLIP_BUFFER_SIZE 2560
+
+/*
+ * Band-limited step synthesis. Amplitude changes are added as deltas at their
+ * exact emulated cycle, each spread over BLIP_WIDTH output samples by a
+ * windowed sinc picked by the sub-sample phase, and the buffer is integrated
+ * when samples are read out. This resamples the GBA's output to any host rate
+ * without aliasing and without running anything per output sample.
+ *
+ * The buffer is stereo, with both sides interleaved so a delta pair is added
+ * in one pass. Amplitudes are in units of 1 / (1 << BLIP_SAMPLE_BITS) of an
+ * output sample. The struct is trivially copyable so it can be part of
+ * SaveState.
+ */
+struct BlipBuffer {
+	/* output samples per clock cycle, 32.32 fixed point */
+	u64 factor = ((u64)SAMPLE_RATE << 32) / CLOCK_RATE;
+	/* position of the current frame's start in the buffer, 32.32 fixed point */
+	u64 offset{};
+	s32 integrator[2]{};
+	s32 buffer[BLIP_BUFFER_SIZE][2]{};
+
+	void set_rates(u32 clock_rate, u32 sample_rate);
+	void clear();
+
+	void add_delta(u32 t, s32 left, s32 right);
+	void end_frame(u32 t);
+	int samples_available();
+	int read_samples(s16 *out, int n);
+};
+
+#endif
@@ -56,6 +56,7 @@ extern const addr_t ENVELOPE_ADDR[4];
 
 struct ChannelState {
 	s32 freq_timer{};
+	u64 last_update{};
 	u32 wave_pos;
 	int current_volume{};
 	int period_timer{};
@@ -83,7 +84,7 @@ struct WaveState {
 };
 
 int get_psg_value(int ch);
-void step_psg(int ch);
+void psg_update();
 void psg_clock_length(int ch);
 void psg_clock_envelope(int ch);
 void psg_trigger_ch(int ch);
@@ -16,6 +16,9 @@ enum cpu_mode_t {
 
 #define NUM_MODES 7
 
+/* user and system mode share a register bank */
+#define NUM_BANKS 6
+
 enum cpsr_flags {
 	T_STATE = BIT(5),
 	FIQ_DISABLE = BIT(6),
@@ -27,7 +30,16 @@ enum cpsr_flags {
 };
 
 enum cpsr_masks {
-	MODE_MASK = BITMASK(4)
+	MODE_MASK = BITMASK(4),
+	NZCV_MASK = BITMASK(4) << 28
+};
+
+/* how the flags of the last flag-setting instruction are to be derived */
+enum flag_ops {
+	FLAGS_CPSR,	/* NZCV in CPSR are up to date */
+	FLAGS_LOGIC,	/* NZ from the result, C and V as recorded */
+	FLAGS_ADD,	/* result = lhs + rhs */
+	FLAGS_SUB	/* result = lhs - rhs */
 };
 
 enum exception_vectors {
@@ -41,15 +53,39 @@ enum exception_vectors {
 	VECTOR_FIQ = 0x1C
 };
 
+/*
+ * The registers of the current mode live in r, with r[15] the PC. The banked
+ * r13/r14 of the other modes, and the r8-r12 of FIQ or of every other mode,
+ * are kept aside and swapped in by switch_mode.
+ */
 struct CPU {
 	// registers
-	u32 registers[NUM_MODES][16]{};
+	u32 r[16]{};
 	u32 CPSR{};
 	u32 SPSR[NUM_MODES]{};
-	u32 pc{};
 	u32 pipeline[3]{};
 
+	u32 banked_sp[NUM_BANKS]{};
+	u32 banked_lr[NUM_BANKS]{};
+	u32 banked_r8_r12[2][5]{};
+
 	bool halted{};
+	bool in_intr_wait{};
+
+	/* time taken by a natively serviced BIOS call that is still to pass */
+	u64 bios_cycles{};
+
+	/*
+	 * Flag-setting instructions only record their result, and for additions
+	 * and subtractions their operands. The NZCV bits of CPSR are stale until
+	 * materialize_flags() works them out, unless flag_op is FLAGS_CPSR.
+	 */
+	u32 flag_op{};
+	u32 flag_result{};
+	u32 flag_lhs{};
+	u32 flag_rhs{};
+	bool flag_carry{};
+	bool flag_overflow{};
 
 	cpu_mode_t cpu_mode{};
 
@@ -88,12 +124,21 @@ struct CPU {
 	void nocycle_write32_noalign(addr_t addr, u32 data);
 
 	u32 *get_reg(int i);
+	u32 *get_user_reg(int i);
 	u32 *get_spsr();
 	u32 *get_sp();
 	u32 *get_lr();
 
 	void set_flag(u32 flag, bool x);
 
+	bool get_carry();
+	bool get_overflow();
+	void set_logic_flags(u32 result, bool carry);
+	void set_flags(u32 result, bool carry, bool overflow);
+	void set_add_flags(u32 lhs, u32 rhs, u32 result);
+	void set_sub_flags(u32 lhs, u32 rhs, u32 result);
+	void materialize_flags();
+
 	bool in_thumb_state();
 	bool in_privileged_mode();
 	bool has_spsr();
@@ -105,4 +150,85 @@ struct CPU {
 
 extern CPU cpu;
 
+inline int mode_bank(cpu_mode_t mode)
+{
+	return mode == USER ? SYSTEM : mode;
+}
+
+inline u32 *CPU::get_reg(int i)
+{
+	return &r[i];
+}
+
+inline u32 *CPU::get_sp()
+{
+	return &r[13];
+}
+
+inline u32 *CPU::get_lr()
+{
+	return &r[14];
+}
+
+inline bool CPU::get_carry()
+{
+	switch (flag_op) {
+		case FLAGS_LOGIC:
+			return flag_carry;
+		case FLAGS_ADD:
+			return flag_result < flag_lhs;
+		case FLAGS_SUB:
+			return flag_lhs >= flag_rhs;
+		default:
+			return CPSR & CARRY_FLAG;
+	}
+}
+
+inline bool CPU::get_overflow()
+{
+	switch (flag_op) {
+		case FLAGS_LOGIC:
+			return flag_overflow;
+		case FLAGS_ADD:
+			return (flag_lhs ^ flag_result) & (flag_rhs ^ flag_result) & BIT(31);
+		case FLAGS_SUB:
+			return (flag_lhs ^ flag_rhs) & (flag_lhs ^ flag_result) & BIT(31);
+		default:
+			return CPSR & OVERFLOW_FLAG;
+	}
+}
+
+/* N and Z from result, C as given, V left as it was */
+inline void CPU::set_logic_flags(u32 result, bool carry)
+{
+	flag_overflow = get_overflow();
+	flag_carry = carry;
+	flag_result = result;
+	flag_op = FLAGS_LOGIC;
+}
+
+inline void CPU::set_flags(u32 result, bool carry, bool overflow)
+{
+	flag_overflow = overflow;
+	flag_carry = carry;
+	flag_result = result;
+	flag_op = FLAGS_LOGIC;
+}
+
+inline void CPU::set_add_flags(u32 lhs, u32 rhs, u32 result)
+{
+	flag_lhs = lhs;
+	flag_rhs = rhs;
+	flag_result = result;
+	flag_op = FLAGS_ADD;
+}
+
+inline void CPU::set_sub_flags(u32 lhs, u32 rhs, u32 result)
+{
+	flag_lhs = lhs;
+	flag_rhs = rhs;
+	flag_result = result;
+	flag_op = FLAGS_SUB;
+}
+
 #endif
@@ -75,6 +75,9 @@ struct DMA {
 
 	void step();
 	void step_channel(int ch);
+	bool burst_channel(int ch);
+	bool eeprom_channel(int ch);
+	void end_transfer(int ch);
 	void update();
 
 	void on_write(addr_t addr, u8 old_value, u8 new_value);
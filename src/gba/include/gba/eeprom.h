@@ -14,7 +14,6 @@ enum eeprom_state_t {
 };
 
 void load_eeprom();
-void save_eeprom();
 
 struct Eeprom {
 	u8 eeprom_memory[MAX_EEPROM_SIZE]{};
@@ -2,33 +2,100 @@
 #define GBAFLARE_EMULATOR_H
 
 #include <common/types.h>
-#include <gba/apu.h>
+#include <gba/memory.h>
 
 #include <string>
 
+#define MAX_RUN_AHEAD 4
+#define NUM_SAVE_SLOTS 10
+
 struct Arguments {
 	std::string bios_filename;
 	std::string cartridge_filename;
+	bool write_saves = true;
+	bool hle_bios = false;
 };
 
 extern Arguments args;
 
+struct SaveState;
+
 struct Emulator {
 	bool cartridge_loaded{};
 
+	/* output switches, deliberately not part of SaveState */
+	bool render_enabled = true;
+	bool audio_enabled = true;
+
+	/* render every nth frame from run_frame, 0 disables rendering */
+	int render_interval = 1;
+	int render_counter{};
+	bool frame_rendered{};
+
+	/* set while run_frame emulates frames that will be rolled back */
+	bool running_ahead{};
+	u16 latched_input = 0xFFFF;
+
+	/* samples written to audiobuffer during the last real frame */
+	int audio_samples{};
+
 	void init(Arguments &args);
+	/* the steps of init, separate so that startup can be timed */
+	void load_rom(Arguments &args);
+	void load_save();
+	void boot(Arguments &args);
+	void set_render_interval(int n);
+	void set_sample_rate(u32 rate);
+	bool next_frame_rendered();
+	void run_frame();
 	void run_one_frame();
+	void latch_input();
 	void close();
 	void reset_memory();
 	void reset();
 	void quit();
+
+	void save_state(SaveState &s);
+	void load_state(const SaveState &s);
 };
 
 extern Emulator emu;
 
 struct SaveState {
-	FIFO fifos[2];
+	CPU cpu;
+	DMA dma;
+	PPU ppu;
 	APU apu;
+	FIFO fifos[NUM_FIFOS];
+	ChannelState channel_states[NUM_PSG_CHANNELS];
+	SweepState sweep_state;
+	NoiseState noise_state;
+	WaveState wave_state;
+	Timer timer;
+	Prefetch prefetch;
+	Flash flash;
+	Eeprom eeprom;
+	int save_type;
+
+	u8 ewram_data[EWRAM_SIZE];
+	u8 iwram_data[IWRAM_SIZE];
+	u8 io_data[IO_SIZE];
+	u8 palette_data[PALETTE_RAM_SIZE];
+	u8 vram_data[VRAM_SIZE];
+	u8 oam_data[OAM_SIZE];
+	u8 sram_data[SRAM_SIZE];
+	u8 wave_ram[2][16];
+
+	u8 waitstate_cycles[NUM_REGIONS][3];
+	u8 cartridge_cycles[3][2][3];
+	u32 last_bios_opcode;
+	bool prefetch_enabled;
+
+	u64 next_event;
+	u64 elapsed;
+	u64 timestamp;
+	u64 cpu_cycles;
+	bool scheduler_flag;
 };
 
 void emulator_save_state(int n);
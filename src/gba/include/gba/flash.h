@@ -29,7 +29,6 @@ struct Flash {
 };
 
 void load_flash();
-void save_flash();
 
 extern Flash flash;
 
@@ -12,6 +12,7 @@
 #include <gba/scheduler.h>
 #include <gba/apu.h>
 #include <gba/channel.h>
+#include <gba/profile.h>
 
 #include <string>
 
@@ -163,6 +164,7 @@ enum MemoryRegion {
 	OAM,
 	CARTRIDGE,
 	SRAM,
+	EEPROM,
 	NUM_REGIONS
 };
 
@@ -211,7 +213,7 @@ struct Prefetch {
 
 extern u8 *const region_to_data[NUM_REGIONS];
 extern u8 *const region_to_data_write[NUM_REGIONS];
-extern const int addr_to_region[16];
+extern int addr_to_region[16];
 extern const u32 region_to_offset_mask[NUM_REGIONS];
 
 extern Cartridge cartridge;
@@ -232,14 +234,16 @@ extern u8 waitstate_cycles[NUM_REGIONS][3];
 extern u8 cartridge_cycles[3][2][3];
 
 extern u32 last_bios_opcode;
+extern bool bios_loaded;
 extern bool prefetch_enabled;
+extern bool save_dirty;
 
 void request_interrupt(u16 flag);
 void load_bios_rom(const std::string &filename);
 void load_cartridge_rom();
 void determine_save_type();
+void update_memory_map();
 void load_sram();
-void save_sram();
 void set_initial_memory_state();
 bool in_vram_bg(addr_t addr);
 void on_waitcntl_write(u8 value);
@@ -294,6 +298,8 @@ template<typename T, int whence> void sram_area_write(addr_t addr, T data)
 {
 	auto save_type = cartridge.save_type;
 
+	save_dirty = true;
+
 	if (save_type == SAVE_SRAM) {
 		sram_write<T, whence>(addr, data);
 	} else if (save_type == SAVE_FLASH64) {
@@ -341,6 +347,7 @@ template<typename T, int whence> void mmio_write(addr_t addr, T data)
 	u32 x = data;
 
 	bool update_affine_ref = false;
+	bool update_sound = false;
 
 	for (std::size_t i = 0; i < sizeof(T); i++) {
 
@@ -373,6 +380,12 @@ template<typename T, int whence> void mmio_write(addr_t addr, T data)
 		u8 old_value = io_data[offset];
 		u8 new_value = (old_value & ~mask) | (to_write & mask);
 
+		/* catch the channels up under the old settings before they change */
+		if (IO_SOUND1CNT_L <= addr + i && addr + i < IO_SOUNDCNT_X + 2) {
+			psg_update();
+			update_sound = true;
+		}
+
 		switch (addr + i) {
 			case IO_TM0CNT_H:
 			case IO_TM1CNT_H:
@@ -458,10 +471,70 @@ template<typename T, int whence> void mmio_write(addr_t addr, T data)
 	if (update_affine_ref) {
 		ppu.copy_affine_ref();
 	}
+
+	if (update_sound) {
+		apu.update_output();
+	}
+}
+
+/* wait states of a gamepak read, which the prefetch buffer may serve */
+template<typename T, int type> void cartridge_read_cycles(addr_t addr)
+{
+	int width_index;
+	if constexpr (sizeof(T) == sizeof(u8)) {
+		width_index = 0;
+	} else if constexpr (sizeof(T) == sizeof(u16)) {
+		width_index = 1;
+	} else {
+		width_index = 2;
+	}
+
+	if (!prefetch_enabled) {
+		cpu_cycles += cartridge_cycles[(((addr >> 24) - 8) / 2)%3][type][width_index];
+	} else {
+		if (addr == prefetch.start && prefetch.size >= sizeof(T)) {
+			prefetch.step(1);
+			cpu_cycles += 1;
+			prefetch.start += sizeof(T);
+			prefetch.size -= sizeof(T);
+		} else if (addr == prefetch.start) {
+			while (prefetch.size < sizeof(T)) {
+				cpu_cycles += prefetch.cycles;
+				prefetch.step(prefetch.cycles);
+			}
+			prefetch.init(addr + sizeof(T));
+		} else {
+			cpu_cycles += cartridge_cycles[(((addr >> 24) - 8) / 2)%3][NSEQ][width_index];
+			prefetch.init(addr + sizeof(T));
+		}
+	}
+}
+
+/*
+ * Reads from the ROM area. Past the end of the ROM the cartridge bus returns
+ * the halfword address, i.e. each halfword reads as its own offset / 2; that
+ * is computed here so loading a ROM only touches the bytes it has.
+ */
+template<typename T> T rom_read(u32 offset)
+{
+	if (offset + sizeof(T) <= cartridge.size) {
+		return readarr<T>(cartridge_data, offset);
+	}
+
+	u32 x = 0;
+	for (std::size_t i = 0; i < sizeof(T); i++) {
+		u32 b = offset + i;
+		u32 byte = b < cartridge.size ? cartridge_data[b] : (b >> 1 & 0xFFFF) >> (b % 2 * 8) & 0xFF;
+		x |= byte << (i * 8);
+	}
+
+	return x;
 }
 
 template<typename T, int whence, int type> T read(addr_t addr)
 {
+	PROFILE_SCOPE(PROFILE_MEMORY);
+
 	T ret = BITMASK(sizeof(T) * 8);
 	int region;
 	u8 *arr;
@@ -469,7 +542,7 @@ template<typename T, int whence, int type> T read(addr_t addr)
 
 	if constexpr (whence == FROM_CPU) {
 		if (addr < 0x4000) {
-			if (cpu.pc >= 0x4000) {
+			if (cpu.r[15] >= 0x4000) {
 				if constexpr (sizeof(T) == sizeof(u8)) {
 					ret = last_bios_opcode >> (addr % 4 * 8);
 				} else {
@@ -519,13 +592,18 @@ template<typename T, int whence, int type> T read(addr_t addr)
 		goto read_end;
 	}
 
-	if (region == MemoryRegion::CARTRIDGE && is_eeprom()) {
+	if (region == MemoryRegion::EEPROM) {
 		if ((addr & eeprom.eeprom_mask) == eeprom.eeprom_mask) {
 			ret = eeprom_read();
 			goto read_end;
 		}
 	}
 
+	if (region == MemoryRegion::CARTRIDGE || region == MemoryRegion::EEPROM) {
+		ret = rom_read<T>(offset);
+		goto read_end;
+	}
+
 	if (region == MemoryRegion::VRAM && offset >= 96_KiB) {
 		offset -= 32_KiB;
 	}
@@ -548,32 +626,14 @@ read_end:
 			width_index = 2;
 		}
 
-		if (region == MemoryRegion::CARTRIDGE) {
+		if (region == MemoryRegion::CARTRIDGE || region == MemoryRegion::EEPROM) {
 			if constexpr (type == NODELAY) {
 				cpu_cycles += 1;
 				if constexpr (sizeof(T) == sizeof(u32)) {
 					cpu_cycles += 1;
 				}
 			} else {
-				if (!prefetch_enabled) {
-					cpu_cycles += cartridge_cycles[(((addr >> 24) - 8) / 2)%3][type][width_index];
-				} else {
-					if (addr == prefetch.start && prefetch.size >= sizeof(T)) {
-						prefetch.step(1);
-						cpu_cycles += 1;
-						prefetch.start += sizeof(T);
-						prefetch.size -= sizeof(T);
-					} else if (addr == prefetch.start) {
-						while (prefetch.size < sizeof(T)) {
-							cpu_cycles += prefetch.cycles;
-							prefetch.step(prefetch.cycles);
-						}
-						prefetch.init(addr + sizeof(T));
-					} else {
-						cpu_cycles += cartridge_cycles[(((addr >> 24) - 8) / 2)%3][NSEQ][width_index];
-						prefetch.init(addr + sizeof(T));
-					}
-				}
+				cartridge_read_cycles<T, type>(addr);
 			}
 		} else {
 			cpu_cycles += waitstate_cycles[region][width_index];
@@ -582,7 +642,7 @@ read_end:
 
 	old = cpu_cycles - old;
 
-	if (prefetch_enabled && region != MemoryRegion::CARTRIDGE && type != NOCYCLES && type != FROM_FETCH) {
+	if (prefetch_enabled && region != MemoryRegion::CARTRIDGE && region != MemoryRegion::EEPROM && type != NOCYCLES && type != FROM_FETCH) {
 		prefetch.step(old);
 	}
 
@@ -591,6 +651,8 @@ read_end:
 
 template<typename T, int whence, int type> void write(addr_t addr, T data)
 {
+	PROFILE_SCOPE(PROFILE_MEMORY);
+
 	int region;
 	u8 *arr;
 	u32 offset;
@@ -604,7 +666,7 @@ template<typename T, int whence, int type> void write(addr_t addr, T data)
 	arr = region_to_data_write[region];
 	offset = addr & region_to_offset_mask[region];
 
-	if (region == MemoryRegion::CARTRIDGE && is_eeprom()) {
+	if (region == MemoryRegion::EEPROM) {
 		if ((addr & eeprom.eeprom_mask) == eeprom.eeprom_mask) {
 			eeprom_write(data);
 			goto write_end;
@@ -667,7 +729,7 @@ write_end:
 			width_index = 2;
 		}
 
-		if (region == MemoryRegion::CARTRIDGE) {
+		if (region == MemoryRegion::CARTRIDGE || region == MemoryRegion::EEPROM) {
 			if constexpr (type == NODELAY) {
 				cpu_cycles += 1;
 				if constexpr (sizeof(T) == sizeof(u32)) {
@@ -683,9 +745,44 @@ write_end:
 
 	old = cpu_cycles - old;
 
-	if (prefetch_enabled && region != MemoryRegion::CARTRIDGE && type != NOCYCLES && type != FROM_FETCH) {
+	if (prefetch_enabled && region != MemoryRegion::CARTRIDGE && region != MemoryRegion::EEPROM && type != NOCYCLES && type != FROM_FETCH) {
 		prefetch.step(old);
 	}
 }
 
+/*
+ * Host pointer to n words at addr if they all lie in one work RAM mirror, where
+ * accesses have no side effects and cost the same sequential or not, so block
+ * transfers can skip the bus; nullptr otherwise.
+ */
+inline u8 *ram_block(addr_t addr, u32 n)
+{
+	if (addr >= 0x1000'0000) {
+		return nullptr;
+	}
+
+	int region = addr_to_region[addr >> 24];
+	if (region != MemoryRegion::EWRAM && region != MemoryRegion::IWRAM) {
+		return nullptr;
+	}
+
+	u32 offset = addr & region_to_offset_mask[region];
+	if (offset + n * 4 > region_to_offset_mask[region] + 1) {
+		return nullptr;
+	}
+
+	return region_to_data[region] + offset;
+}
+
+/* the cycles n word accesses through the bus would have taken */
+inline void ram_block_cycles(addr_t addr, u32 n)
+{
+	u32 cycles = waitstate_cycles[addr_to_region[addr >> 24]][2] * n;
+
+	cpu_cycles += cycles;
+	if (prefetch_enabled) {
+		prefetch.step(cycles);
+	}
+}
+
 #endif
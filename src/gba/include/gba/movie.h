@@ -0,0 +1,66 @@
+#ifndef GBAFLARE_MOVIE_H
+#define GBAFLARE_MOVIE_H
+
+#include <common/types.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#define MOVIE_MAGIC "GBAFMOVI"
+#define MOVIE_VERSION 1
+
+enum movie_modes {
+	MOVIE_NONE,
+	MOVIE_RECORDING,
+	MOVIE_PLAYBACK
+};
+
+enum movie_frame_flags {
+	MOVIE_FRAME_VIDEO = 0x1
+};
+
+struct SaveState;
+
+struct MovieFrame {
+	u16 joypad_state;
+	u8 flags;
+	u64 hash;
+};
+
+/*
+ * An input movie: the ROM and BIOS it was recorded against, the machine state
+ * at the first frame, and for every frame the joypad state latched at VBlank
+ * together with a hash of that frame's video and audio output.
+ */
+struct Movie {
+	int mode{};
+
+	u64 rom_hash{};
+	u64 bios_hash{};
+	std::string rom_name;
+	std::unique_ptr<SaveState> initial_state;
+	std::vector<MovieFrame> frames;
+
+	std::size_t frame_index{};
+	std::size_t mismatches{};
+	std::size_t first_mismatch{};
+
+	bool start_recording();
+	bool start_playback();
+	void stop();
+	bool active();
+
+	bool save(const std::string &filename);
+	bool load(const std::string &filename);
+
+	u16 on_frame_end(u16 joypad_state, bool video);
+};
+
+extern Movie movie;
+
+u64 hash_rom();
+u64 hash_bios();
+u64 hash_frame_output(bool video);
+
+#endif
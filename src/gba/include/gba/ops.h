@@ -4,82 +4,125 @@
 #include <common/types.h>
 
 #define WRITE_PC(x) \
-cpu.pc = (x);\
+cpu.r[15] = (x);\
 cpu.flush_pipeline();
 
 #define BRANCH_X_RM \
 cpu.set_flag(T_STATE, rm & BIT(0));\
 WRITE_PC(rm & 0xFFFFFFFE);
 
+/*
+ * The flags are evaluated lazily, see CPU::flag_op. Only C is fetched up
+ * front, since the barrel shifter and the carry-in instructions consume it.
+ */
 #define GET_CPU_FLAGS \
-bool N = cpu.CPSR & SIGN_FLAG;\
-bool Z = cpu.CPSR & ZERO_FLAG;\
-bool C = cpu.CPSR & CARRY_FLAG;\
-bool V = cpu.CPSR & OVERFLOW_FLAG;
+bool C = cpu.get_carry();
 
-#define WRITE_CPU_FLAGS \
-cpu.set_flag(SIGN_FLAG, N);\
-cpu.set_flag(ZERO_FLAG, Z);\
-cpu.set_flag(CARRY_FLAG, C);\
-cpu.set_flag(OVERFLOW_FLAG, V);
+#define LOGIC_FLAGS \
+if constexpr (set_cond) {\
+	cpu.set_logic_flags(r, C);\
+}
 
-#define NZ_FLAGS_RD \
-N = r & BIT(31);\
-Z = (r == 0) ? 1 : 0;
+#define ADD_FLAGS \
+if constexpr (set_cond) {\
+	cpu.set_add_flags(rn, operand, r);\
+}
 
-#define CV_FLAGS_ADD \
-C = result > 0xFFFF'FFFF;\
-V = (rn ^ r) & (operand ^ r) & 0x8000'0000;
+#define SUB_FLAGS \
+if constexpr (set_cond) {\
+	cpu.set_sub_flags(rn, operand, r);\
+}
 
-#define CV_FLAGS_SUB \
-C = !(rn < operand);\
-V = (rn ^ operand) & (rn ^ r) & 0x8000'0000;
+#define CARRY_FLAGS(c, v) \
+if constexpr (set_cond) {\
+	cpu.set_flags(r, (c), (v));\
+}
 
-#define AND_STYLE \
+#define WRITE_RD_STYLE \
 if (rdi == 15) {\
 	copy_spsr = true;\
 	pc_written = true;\
-}\
-NZ_FLAGS_RD;
+}
 
-#define TEST_STYLE \
+#define TEST_RD_STYLE \
 if (rdi == 15) {\
 	copy_spsr = true;\
-}\
-NZ_FLAGS_RD;
+}
+
+#define AND_STYLE \
+WRITE_RD_STYLE;\
+LOGIC_FLAGS;
+
+#define TEST_STYLE \
+TEST_RD_STYLE;\
+LOGIC_FLAGS;
 
 #define ADD_STYLE \
-AND_STYLE;\
-CV_FLAGS_ADD;
+WRITE_RD_STYLE;\
+ADD_FLAGS;
 
+#define SUB_STYLE \
+WRITE_RD_STYLE;\
+SUB_FLAGS;
+
+/*
+ * Runs that lie entirely in work RAM are copied straight from the host
+ * buffer, charging the cycles once; anything else goes through the bus.
+ */
 #define __WRITE_MULTIPLE(x, target) \
 bool first = true;\
-for (int i = 0; i <= (x); i++) {\
-	if (register_list & BIT(i)) {\
-		if (first) {\
-			cpu.nwrite32_noalign(address+rem, (target));\
-			first = false;\
-		} else {\
-			cpu.swrite32_noalign(address+rem, (target));\
+if (u8 *block = ram_block(address, std::popcount(register_list & BITMASK((x) + 1)))) {\
+	u32 n = 0;\
+	for (int i = 0; i <= (x); i++) {\
+		if (register_list & BIT(i)) {\
+			writearr<u32>(block, n * 4, (target));\
+			n++;\
+		}\
+	}\
+	ram_block_cycles(address, n);\
+	address += n * 4;\
+	first = n == 0;\
+} else {\
+	for (int i = 0; i <= (x); i++) {\
+		if (register_list & BIT(i)) {\
+			if (first) {\
+				cpu.nwrite32_noalign(address+rem, (target));\
+				first = false;\
+			} else {\
+				cpu.swrite32_noalign(address+rem, (target));\
+			}\
+			address += 4;\
 		}\
-		address += 4;\
 	}\
 }\
 if (register_list == 0) {\
-	cpu.nwrite32_noalign(address+rem, cpu.pc + (cpu.in_thumb_state() ? 2 : 4));\
+	cpu.nwrite32_noalign(address+rem, cpu.r[15] + (cpu.in_thumb_state() ? 2 : 4));\
 }
 
 #define __READ_MULTIPLE(x, target) \
 bool first = true;\
-for (int i = 0; i <= (x); i++) {\
-	if (register_list & BIT(i)) {\
-		if (first) {\
-			(target) = cpu.nread32_noalign(address+rem);\
-			first = false;\
-		} else {\
-			(target) = cpu.sread32_noalign(address+rem);\
+if (u8 *block = ram_block(address, std::popcount(register_list & BITMASK((x) + 1)))) {\
+	u32 n = 0;\
+	for (int i = 0; i <= (x); i++) {\
+		if (register_list & BIT(i)) {\
+			(target) = readarr<u32>(block, n * 4);\
+			n++;\
+		}\
+	}\
+	ram_block_cycles(address, n);\
+	address += n * 4;\
+	first = n == 0;\
+} else {\
+	for (int i = 0; i <= (x); i++) {\
+		if (register_list & BIT(i)) {\
+			if (first) {\
+				(target) = cpu.nread32_noalign(address+rem);\
+				first = false;\
+			} else {\
+				(target) = cpu.sread32_noalign(address+rem);\
+			}\
+			address += 4;\
 		}\
-		address += 4;\
 	}\
 }\
 if (register_list == 0) {\
@@ -94,10 +137,10 @@ __READ_MULTIPLE((x), *cpu.get_reg(i));
 __WRITE_MULTIPLE((x), *cpu.get_reg(i));
 
 #define READ_MULTIPLE_FORCE_USER(x) \
-__READ_MULTIPLE((x), cpu.registers[0][i]);
+__READ_MULTIPLE((x), *cpu.get_user_reg(i));
 
 #define WRITE_MULTIPLE_FORCE_USER(x) \
-__WRITE_MULTIPLE((x), cpu.registers[0][i]);
+__WRITE_MULTIPLE((x), *cpu.get_user_reg(i));
 
 #define BARREL_SHIFTER(x, k) \
 if constexpr (shift_type == 0) {\
@@ -37,6 +37,12 @@ enum ppu_modes {
 	PPU_IN_VBLANK_2
 };
 
+enum output_formats {
+	OUTPUT_BGR555,
+	OUTPUT_RGB565,
+	OUTPUT_XRGB8888
+};
+
 enum render_layers {
 	LAYER_BG0,
 	LAYER_BG1,
@@ -184,11 +190,6 @@ struct pixel_info {
 struct PPU {
 	u32 cycles{};
 
-	pixel_info bufferA[FRAMEBUFFER_SIZE]{};
-	pixel_info bufferB[FRAMEBUFFER_SIZE]{};
-	pixel_info obj_buffer[FRAMEBUFFER_SIZE]{};
-	bool obj_window[LCD_WIDTH]{};
-
 	window_info windows[2]{};
 
 	ppu_modes ppu_mode = PPU_IN_DRAW;
@@ -223,6 +224,7 @@ struct PPU {
 	bool should_push_pixel(int bg, int x, bool &blend);
 	void check_window(int n, int x);
 	void copy_affine_ref();
+	void step_affine_ref();
 	void setup_windows();
 	void setup_window(int n);
 
@@ -231,4 +233,14 @@ struct PPU {
 
 extern PPU ppu;
 
+/* the pixel format of framebuffer, a display setting that is not part of SaveState */
+extern int output_format;
+extern bool output_color_correction;
+
+/* the frame as composed, in BGR555 whatever the output format; what movies hash */
+extern u16 composed_frame[FRAMEBUFFER_SIZE];
+
+void set_output_format(int format, bool color_correction);
+int output_pixel_size();
+
 #endif
@@ -0,0 +1,44 @@
+#ifndef GBAFLARE_PROFILE_H
+#define GBAFLARE_PROFILE_H
+
+#include <csignal>
+
+enum profile_sections {
+	PROFILE_OTHER,
+	PROFILE_SCHEDULER,
+	PROFILE_CPU,
+	PROFILE_MEMORY,
+	PROFILE_PPU,
+	PROFILE_APU,
+	PROFILE_DMA,
+	PROFILE_TIMER,
+	NUM_PROFILE_SECTIONS
+};
+
+extern const char *profile_section_names[NUM_PROFILE_SECTIONS];
+
+#ifdef GBAFLARE_PROFILE
+
+/*
+ * The subsystem the emulator thread is currently in. Scopes nest, so time is
+ * attributed exclusively to the innermost one. gbaflare-bench samples this
+ * from a profiling timer signal.
+ */
+extern volatile std::sig_atomic_t profile_section;
+
+struct ProfileScope {
+	std::sig_atomic_t prev;
+
+	ProfileScope(int section) : prev(profile_section) { profile_section = section; }
+	~ProfileScope() { profile_section = prev; }
+};
+
+#define PROFILE_SCOPE(section) ProfileScope profile_scope(section)
+
+#else
+
+#define PROFILE_SCOPE(section)
+
+#endif
+
+#endif
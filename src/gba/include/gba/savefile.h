@@ -0,0 +1,51 @@
+#ifndef GBAFLARE_SAVEFILE_H
+#define GBAFLARE_SAVEFILE_H
+
+#include <common/types.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* frames without a save write before the save is flushed to disk */
+#define SAVE_FLUSH_DELAY 60
+
+/*
+ * Persists the battery save while the game runs. Writes to save memory mark it
+ * dirty; once the game has left it alone for SAVE_FLUSH_DELAY frames the
+ * emulator thread snapshots it and a writer thread replaces the save file
+ * atomically, so a crash leaves either the old or the new save on disk.
+ * Snapshots identical to the last one written are dropped.
+ */
+struct SaveFlusher {
+	~SaveFlusher();
+
+	void start(const std::string &filename);
+	void on_frame_end();
+	void stop();
+	bool active();
+
+	private:
+	std::string filename;
+	std::vector<u8> written;
+	bool changed{};
+	int idle_frames{};
+
+	std::vector<u8> pending;
+	bool has_pending{};
+	bool stopping{};
+	std::mutex lock;
+	std::condition_variable wake;
+	std::thread writer;
+
+	void submit();
+	void run();
+};
+
+extern SaveFlusher save_flusher;
+
+bool write_file_atomic(const std::string &filename, const u8 *data, std::size_t size);
+
+#endif
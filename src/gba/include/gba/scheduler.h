@@ -6,6 +6,15 @@
 extern u64 next_event;
 extern u64 elapsed;
 extern bool scheduler_flag;
+extern u64 cpu_cycles;
+
+/* cycles from reset to the last event processing */
+extern u64 timestamp;
+
+inline u64 current_time()
+{
+	return timestamp + cpu_cycles;
+}
 
 void start_event_processing();
 
@@ -14,6 +23,4 @@ void schedule_after(u64 dt);
 
 void end_event_processing();
 
-extern u64 cpu_cycles;
-
 #endif
@@ -5,6 +5,9 @@
 
 #define NUM_TIMERS 4
 
+/* next_overflow while no timer is running on its own clock */
+#define TIMER_NEVER UINT64_MAX
+
 enum tmcnt_flags {
 	TIMER_PRESCALE	= 0x3,
 	TIMER_COUNTUP	= 0x4,
@@ -16,16 +19,25 @@ enum tmcnt_flags {
 #define TMCNT_L(x) io_data[IO_TM0CNT_L - IO_START + 4*(x)]
 #define TMCNT_H(x) io_data[IO_TM0CNT_H - IO_START + 4*(x)]
 
+/*
+ * The counters are only brought up to date when they are read or written, or
+ * when an event lands on or after the earliest overflow: the ticks since the
+ * last update are added in one go and only overflows are stepped through.
+ */
 struct Timer {
-	u64 timer_cycles{};
-	u64 last_timer_update{};
+	/* current_time() the counters were last brought up to */
+	u64 last_update{};
+	/* current_time() of the earliest overflow of a running timer, 0 if unknown */
+	u64 next_overflow{};
 
 	u32 tcycles[NUM_TIMERS]{};
 	u32 values[NUM_TIMERS]{};
 	u16 reload[NUM_TIMERS]{};
 
 	void step();
+	void update();
 	void simulate_elapsed(u64 dt);
+	void advance(int i, u32 ticks);
 	void do_timer_increment(int i);
 	void on_timer_overflow(int i);
 
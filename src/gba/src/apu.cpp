@@ -3,10 +3,13 @@
 #include <gba/memory.h>
 #include <gba/dma.h>
 #include <gba/channel.h>
+#include <gba/emulator.h>
 
 const int psg_volume_div[4] = {4, 2, 1, 1};
 const int wave_volume_factor[4] = {0, 4, 2, 1};
 
+constexpr int OUTPUT_GAIN = 20;
+
 FIFO fifos[NUM_FIFOS];
 APU apu;
 
@@ -45,87 +48,182 @@ u8 FIFO::dequeue()
 	return x;
 }
 
-void APU::step()
+/* gain of one unit of PSG channel level on one side, in blip amplitude units */
+static s32 psg_gain(int ch, int side)
 {
-	sample_cycles += elapsed;
+	u16 soundcnt_x = io_read<u16>(IO_SOUNDCNT_X);
+	if (!(soundcnt_x & SOUND_MASTER_ENABLE) || !channel_states[ch-1].enabled) {
+		return 0;
+	}
+
+	u16 soundcnt_l = io_read<u16>(IO_SOUNDCNT_L);
+	u16 soundcnt_h = io_read<u16>(IO_SOUNDCNT_H);
 
-	if (sample_cycles >= CYCLES_PER_SAMPLE) {
-		sample_cycles -= CYCLES_PER_SAMPLE;
+	int master;
+	if (side == AUDIO_LEFT) {
+		if (!(soundcnt_l & (SOUND1_LEFT_ON * BIT(ch-1)))) {
+			return 0;
+		}
+		master = GET_FLAG(soundcnt_l, PSG_LEFT_VOL);
+	} else {
+		if (!(soundcnt_l & (SOUND1_RIGHT_ON * BIT(ch-1)))) {
+			return 0;
+		}
+		master = GET_FLAG(soundcnt_l, PSG_RIGHT_VOL);
+	}
 
-		s16 left = 0;
-		s16 right = 0;
+	int wave = 4;
+	if (ch == 3) {
+		u16 cnt3 = io_read<u16>(IO_SOUND3CNT_H);
+		if (GET_FLAG(cnt3, WAVE_FORCE)) {
+			wave = 3;
+		} else {
+			wave = wave_volume_factor[GET_FLAG(cnt3, WAVE_VOL)];
+		}
+	}
 
-		s16 psg_left = 0;
-		s16 psg_right = 0;
+	/* level * 16 / psg_volume_div * wave / 4 * master / 7, scaled by OUTPUT_GAIN */
+	return (16 * OUTPUT_GAIN * wave * master << BLIP_SAMPLE_BITS) / (psg_volume_div[soundcnt_h & PSG_VOL] * 4 * 7);
+}
 
-		u16 soundcnt_l = io_read<u16>(IO_SOUNDCNT_L);
-		u16 soundcnt_x = io_read<u16>(IO_SOUNDCNT_X);
-		u16 soundcnt_h = io_read<u16>(IO_SOUNDCNT_H);
-		if (soundcnt_x & SOUND_MASTER_ENABLE) {
-			for (int i = 0; i < NUM_FIFOS; i++) {
-				int v = fifo_v[i] * 4;
-				if (soundcnt_h & (DMA_A_VOL * BIT(i))) {
-					v /= 2;
-				}
+static s32 fifo_gain(int i, int side)
+{
+	u16 soundcnt_x = io_read<u16>(IO_SOUNDCNT_X);
+	u16 soundcnt_h = io_read<u16>(IO_SOUNDCNT_H);
 
-				if (soundcnt_h & (DMA_A_LEFT * BIT(i*4))) {
-					left += v;
-				}
+	if (!(soundcnt_x & SOUND_MASTER_ENABLE)) {
+		return 0;
+	}
 
-				if (soundcnt_h & (DMA_A_RIGHT * BIT(i*4))) {
-					right += v;
-				}
-			}
+	if (!(soundcnt_h & ((side == AUDIO_LEFT ? DMA_A_LEFT : DMA_A_RIGHT) * BIT(i*4)))) {
+		return 0;
+	}
 
-			for (int ch = 1; ch <= NUM_PSG_CHANNELS; ch++) {
-				if (channel_states[ch-1].enabled) {
-					int v = get_psg_value(ch) * 16;
-					v = v / psg_volume_div[soundcnt_h & PSG_VOL];
-
-					if (ch == 3) {
-						u16 cnt3 = io_read<u16>(IO_SOUND3CNT_H);
-						if (GET_FLAG(cnt3, WAVE_FORCE)) {
-							v = v * 3 / 4;
-						} else {
-							v = v * wave_volume_factor[GET_FLAG(cnt3, WAVE_VOL)] / 4;
-						}
-					}
-
-					if (soundcnt_l & (SOUND1_RIGHT_ON * BIT(ch-1))) {
-						psg_right += v;
-					}
-					if (soundcnt_l & (SOUND1_LEFT_ON * BIT(ch-1))) {
-						psg_left += v;
-					}
-
-				}
-			}
+	int gain = 4 * OUTPUT_GAIN;
+	if (soundcnt_h & (DMA_A_VOL * BIT(i))) {
+		gain /= 2;
+	}
+
+	return gain << BLIP_SAMPLE_BITS;
+}
+
+void APU::add_delta(u64 t, s32 left, s32 right)
+{
+	if (left == 0 && right == 0) {
+		return;
+	}
+
+	output[AUDIO_LEFT] += left;
+	output[AUDIO_RIGHT] += right;
+
+	if (!emu.audio_enabled) {
+		return;
+	}
+
+	u32 dt = t - frame_start;
+
+	if (num_deltas > 0 && deltas[num_deltas-1].t == dt) {
+		deltas[num_deltas-1].left += left;
+		deltas[num_deltas-1].right += right;
+		return;
+	}
+
+	if (num_deltas == AUDIO_LOG_SIZE) {
+		flush_deltas();
+	}
+
+	deltas[num_deltas++] = {dt, left, right};
+}
+
+void APU::flush_deltas()
+{
+	PROFILE_SCOPE(PROFILE_APU);
+
+	for (int i = 0; i < num_deltas; i++) {
+		blip.add_delta(deltas[i].t, deltas[i].left, deltas[i].right);
+	}
+
+	num_deltas = 0;
+}
+
+void APU::set_sample_rate(u32 rate)
+{
+	blip.set_rates(CLOCK_RATE, rate);
+}
+
+/* a PSG channel stepped to a new level at cycle t */
+void APU::on_psg_step(int ch, u64 t, int level)
+{
+	int d = level - psg_levels[ch-1];
+	if (d == 0) {
+		return;
+	}
+
+	psg_levels[ch-1] = level;
+	add_delta(t, d * psg_gains[AUDIO_LEFT][ch-1], d * psg_gains[AUDIO_RIGHT][ch-1]);
+}
+
+/*
+ * Recomputes the gains and the whole mix at the current cycle. Called after
+ * anything other than a channel step or FIFO pop may have changed the output.
+ */
+void APU::update_output()
+{
+	psg_update();
+
+	for (int ch = 1; ch <= NUM_PSG_CHANNELS; ch++) {
+		psg_levels[ch-1] = get_psg_value(ch);
+	}
+
+	s32 total[2]{};
+
+	for (int side = 0; side < 2; side++) {
+		for (int i = 0; i < NUM_FIFOS; i++) {
+			fifo_gains[side][i] = fifo_gain(i, side);
+			total[side] += fifo_v[i] * fifo_gains[side][i];
 		}
 
-		int k = 20;
+		for (int ch = 1; ch <= NUM_PSG_CHANNELS; ch++) {
+			psg_gains[side][ch-1] = psg_gain(ch, side);
+			total[side] += psg_levels[ch-1] * psg_gains[side][ch-1];
+		}
+	}
 
-		psg_left = psg_left * GET_FLAG(soundcnt_l, PSG_LEFT_VOL) / 7;
-		psg_right = psg_right * GET_FLAG(soundcnt_l, PSG_RIGHT_VOL) / 7;
+	add_delta(current_time(), total[AUDIO_LEFT] - output[AUDIO_LEFT], total[AUDIO_RIGHT] - output[AUDIO_RIGHT]);
+}
 
+/* finishes the audio frame and writes its interleaved stereo samples to out */
+int APU::end_frame(s16 *out, int max_samples)
+{
+	psg_update();
+	flush_deltas();
 
-		left += psg_left;
-		right += psg_right;
+	u64 now = current_time();
+	u32 t = now - frame_start;
+	frame_start = now;
 
-		audiobuffer[audio_buffer_index++] = left*k;
-		audiobuffer[audio_buffer_index++] = right*k;
+	if (!emu.audio_enabled) {
+		blip.clear();
+		return 0;
 	}
 
-	schedule_after(CYCLES_PER_SAMPLE - sample_cycles);
+	blip.end_frame(t);
+
+	return blip.read_samples(out, max_samples / 2) * 2;
 }
 
 void APU::channel_step()
 {
+	PROFILE_SCOPE(PROFILE_APU);
+
 	frameseq_cycles += elapsed;
 	if (frameseq_cycles >= CYCLES_PER_FS_TICK) {
 		frameseq_cycles -= CYCLES_PER_FS_TICK;
 
 		frame_sequencer = (frame_sequencer + 1) % 8;
 
+		psg_update();
+
 		if (frame_sequencer % 2 == 0) {
 			clock_length();
 		}
@@ -137,14 +235,11 @@ void APU::channel_step()
 		if (frame_sequencer == 2 || frame_sequencer == 6) {
 			clock_sweep();
 		}
+
+		update_output();
 	}
 
 	schedule_after(CYCLES_PER_FS_TICK - frameseq_cycles);
-
-	step_psg(1);
-	step_psg(2);
-	step_psg(3);
-	step_psg(4);
 }
 
 void APU::on_timer_overflow(int i)
@@ -152,7 +247,12 @@ void APU::on_timer_overflow(int i)
 	u16 soundcnt_h = io_read<u16>(IO_SOUNDCNT_H);
 	for (int k = 0; k < 2; k++) {
 		if ((bool)(soundcnt_h & (DMA_A_TIMER * BIT(k*4))) == i) {
+			s8 old = fifo_v[k];
 			fifo_v[k] = fifos[k].dequeue();
+
+			int d = fifo_v[k] - old;
+			add_delta(current_time(), d * fifo_gains[AUDIO_LEFT][k], d * fifo_gains[AUDIO_RIGHT][k]);
+
 			if (fifos[k].size <= 16 && dma.transfers[k+1].enabled() && dma.transfers[k+1].is_special()) {
 				dma.dma_active |= BIT(k+1);
 			}
@@ -2,6 +2,7 @@
 #include <gba/cpu.h>
 #include <gba/ops.h>
 #include <gba/memory.h>
+#include <gba/bios.h>
 
 #include <iostream>
 #include <stdexcept>
@@ -30,10 +31,10 @@ void arm_branch(u32 op)
 
 	if constexpr (link) {
 		u32 *lr = cpu.get_lr();
-		*lr = cpu.pc - 4;
+		*lr = cpu.r[15] - 4;
 	}
 
-	WRITE_PC(cpu.pc + nn * 4);
+	WRITE_PC(cpu.r[15] + nn * 4);
 	cpu.sfetch();
 }
 
@@ -105,33 +106,31 @@ void arm_alu(u32 op)
 		AND_STYLE;
 	} else if constexpr (aluop == OP_SUB) {
 		u32 r = *rd = rn - operand;
-		AND_STYLE;
-		CV_FLAGS_SUB;
+		SUB_STYLE;
 	} else if constexpr (aluop == OP_RSB) {
 		u32 r = *rd = operand - rn;
-		AND_STYLE;
-		C = !(operand < rn);
-		V = (rn ^ operand) & (operand ^ *rd) & 0x8000'0000;
+		WRITE_RD_STYLE;
+		if constexpr (set_cond) {
+			cpu.set_sub_flags(operand, rn, r);
+		}
 	} else if constexpr (aluop == OP_ADD) {
-		u64 result = (u64)rn + operand;
-		u32 r = *rd = result;
+		u32 r = *rd = rn + operand;
 		ADD_STYLE;
 	} else if constexpr (aluop == OP_ADC) {
 		u64 result = (u64)rn + operand + old_carry;
 		u32 r = *rd = result;
-		ADD_STYLE;
+		WRITE_RD_STYLE;
+		CARRY_FLAGS(result > 0xFFFF'FFFF, (rn ^ r) & (operand ^ r) & 0x8000'0000);
 	} else if constexpr (aluop == OP_SBC) {
 		s64 result = (s64)rn - operand - (!old_carry);
 		u32 r = *rd = result;
-		AND_STYLE;
-		C = !(result < 0);
-		V = (rn ^ operand) & (rn ^ r) & 0x8000'0000;
+		WRITE_RD_STYLE;
+		CARRY_FLAGS(!(result < 0), (rn ^ operand) & (rn ^ r) & 0x8000'0000);
 	} else if constexpr (aluop == OP_RSC) {
 		s64 result = (s64)operand - rn - (!old_carry);
 		u32 r = *rd = result;
-		AND_STYLE;
-		C = !(result < 0);
-		V = (rn ^ operand) & (operand ^ r) & 0x8000'0000;
+		WRITE_RD_STYLE;
+		CARRY_FLAGS(!(result < 0), (rn ^ operand) & (operand ^ r) & 0x8000'0000);
 	} else if constexpr (aluop == OP_TST) {
 		u32 r = rn & operand;
 		TEST_STYLE;
@@ -140,13 +139,12 @@ void arm_alu(u32 op)
 		TEST_STYLE;
 	} else if constexpr (aluop == OP_CMP) {
 		u32 r = rn - operand;
-		TEST_STYLE;
-		CV_FLAGS_SUB;
+		TEST_RD_STYLE;
+		SUB_FLAGS;
 	} else if constexpr (aluop == OP_CMN) {
-		u64 result = (u64)rn + operand;
-		u32 r = result;
-		TEST_STYLE;
-		CV_FLAGS_ADD;
+		u32 r = rn + operand;
+		TEST_RD_STYLE;
+		ADD_FLAGS;
 	} else if constexpr (aluop == OP_ORR) {
 		u32 r = *rd = rn | operand;
 		AND_STYLE;
@@ -163,10 +161,9 @@ void arm_alu(u32 op)
 
 	if constexpr (set_cond) {
 		if (copy_spsr) {
+			cpu.materialize_flags();
 			cpu.CPSR = *cpu.get_spsr();
 			cpu.update_mode();
-		} else {
-			WRITE_CPU_FLAGS;
 		}
 	}
 
@@ -196,7 +193,11 @@ void arm_mul(u32 op)
 	u32 *rd = cpu.get_reg(op >> 16 & BITMASK(4));
 	u32 *rn = cpu.get_reg(op >> 12 & BITMASK(4));
 
-#define NZ_FLAGS_LONG N = *rd & BIT(31); Z = (*rd == 0 && *rn == 0) ? 1 : 0;
+/* N from the high word, Z only if both words are zero */
+#define NZ_FLAGS_LONG \
+if constexpr (set_cond) {\
+	cpu.set_logic_flags(*rd | (*rn != 0), C);\
+}
 
 #define MULTIPLY_LONG_CARRY \
 u64 result_lo = (result & BITMASK(32)) + *rn;\
@@ -212,12 +213,12 @@ NZ_FLAGS_LONG;
 
 	if constexpr (mulop == 0) {
 		u32 r = *rd = rm * rs;
-		NZ_FLAGS_RD;
+		LOGIC_FLAGS;
 		MUL_ONES_ZEROS;
 		cpu.icycle(m);
 	} else if constexpr (mulop == 1) {
 		u32 r = *rd = rm * rs + *rn;
-		NZ_FLAGS_RD;
+		LOGIC_FLAGS;
 		MUL_ONES_ZEROS;
 		cpu.icycle(m+1);
 	} else if constexpr (mulop == 4) {
@@ -242,10 +243,6 @@ NZ_FLAGS_LONG;
 		cpu.icycle(m+2);
 	}
 
-	if constexpr (set_cond) {
-		WRITE_CPU_FLAGS;
-	}
-
 	if (!prefetch_enabled) {
 		cpu.nfetch();
 	} else {
@@ -258,6 +255,7 @@ void arm_psr(u32 op)
 {
 	if constexpr (dir == 0) {
 		u32 *rd = cpu.get_reg(op >> 12 & BITMASK(4));
+		cpu.materialize_flags();
 		if constexpr (psr == 1) {
 			*rd = *cpu.get_spsr();
 		} else {
@@ -277,6 +275,7 @@ for (int i = 0; i < 4; i++) {\
 #define MSR_STYLE \
 u32 field_mask = op >> 16 & BITMASK(4);\
 if constexpr (psr == 0) {\
+	cpu.materialize_flags();\
 	if (!cpu.in_privileged_mode()) {\
 		field_mask &= ~BITMASK(3);\
 	}\
@@ -302,6 +301,7 @@ void arm_msr_imm(u32 op)
 	u32 imm = op & BITMASK(8);
 	u32 rotate_imm = op >> 8 & BITMASK(4);
 
+	cpu.materialize_flags();
 	bool carry = cpu.CPSR & CARRY_FLAG;
 
 	u32 operand = ror(imm, rotate_imm * 2, carry);
@@ -341,7 +341,7 @@ if constexpr (prepost == 1) {\
 	}\
 }
 
-	bool carry = cpu.CPSR & CARRY_FLAG;
+	bool carry = cpu.get_carry();
 
 	if constexpr (reg_offset == 0) {
 		u32 offset = op & BITMASK(12);
@@ -395,7 +395,7 @@ void arm_swp(u32 op)
 	u32 rm = *cpu.get_reg(op & BITMASK(4));
 	u32 *rd = cpu.get_reg(op >> 12 & BITMASK(4));
 
-	bool carry = cpu.CPSR & CARRY_FLAG;
+	bool carry = cpu.get_carry();
 
 	u32 address = rn;
 
@@ -531,6 +531,7 @@ void arm_block_dt(u32 op)
 	} else if (load == 1 && psr == 1 && (op & BIT(15))) {
 		READ_MULTIPLE(14);
 
+		cpu.materialize_flags();
 		cpu.CPSR = *cpu.get_spsr();
 		cpu.update_mode();
 
@@ -547,9 +548,9 @@ void arm_block_dt(u32 op)
 
 		if (register_list & BIT(15)) {
 			if (first) {
-				cpu.nwrite32_noalign(address+rem, cpu.pc + 4);
+				cpu.nwrite32_noalign(address+rem, cpu.r[15] + 4);
 			} else {
-				cpu.swrite32_noalign(address+rem, cpu.pc + 4);
+				cpu.swrite32_noalign(address+rem, cpu.r[15] + 4);
 			}
 		}
 
@@ -558,9 +559,9 @@ void arm_block_dt(u32 op)
 
 		if (register_list & BIT(15)) {
 			if (first) {
-				cpu.nwrite32_noalign(address+rem, cpu.pc);
+				cpu.nwrite32_noalign(address+rem, cpu.r[15]);
 			} else {
-				cpu.swrite32_noalign(address+rem, cpu.pc);
+				cpu.swrite32_noalign(address+rem, cpu.r[15]);
 			}
 		}
 	}
@@ -585,7 +586,10 @@ void arm_block_dt(u32 op)
 
 void arm_swi(u32 op)
 {
-	(void)op;
+	if (hle_bios && bios_call(op >> 16 & BITMASK(8))) {
+		cpu.sfetch();
+		return;
+	}
 
 	cpu.exception_prologue(SUPERVISOR, 0x13);
 	WRITE_PC(VECTOR_SWI);
@@ -0,0 +1,757 @@
+#include <gba/bios.h>
+#include <gba/cpu.h>
+#include <gba/ops.h>
+#include <gba/memory.h>
+
+#include <vector>
+#include <cmath>
+#include <numbers>
+#include <bit>
+
+bool hle_bios;
+
+/*
+ * Exception vectors and IRQ dispatcher used when there is no BIOS image. The
+ * IRQ handler sits at the same address as in the real BIOS so the open bus
+ * value seen after an interrupt matches.
+ */
+static const u32 hle_vectors[8] = {
+	0xE3A0F302,	/* 00: mov pc, #0x08000000 */
+	0xE1B0F00E,	/* 04: movs pc, lr */
+	0xE1B0F00E,	/* 08: movs pc, lr (SWIs not handled natively) */
+	0xE25EF004,	/* 0C: subs pc, lr, #4 */
+	0xE25EF004,	/* 10: subs pc, lr, #4 */
+	0xE25EF004,	/* 14: subs pc, lr, #4 */
+	0xEA000042,	/* 18: b 0x128 */
+	0xE25EF004	/* 1C: subs pc, lr, #4 */
+};
+
+static const u32 hle_irq_handler[6] = {
+	0xE92D500F,	/* stmfd sp!, {r0-r3, r12, lr} */
+	0xE3A00301,	/* mov r0, #0x04000000 */
+	0xE28FE000,	/* add lr, pc, #0 */
+	0xE510F004,	/* ldr pc, [r0, #-4] */
+	0xE8BD500F,	/* ldmfd sp!, {r0-r3, r12, lr} */
+	0xE25EF004	/* subs pc, lr, #4 */
+};
+
+#define HLE_IRQ_HANDLER 0x128
+
+/* sine in 1.14 fixed point, one full turn over 256 entries like the BIOS table */
+static s16 sine_lut[256];
+
+void install_hle_bios()
+{
+	ZERO_ARR(bios_data);
+
+	for (int i = 0; i < 8; i++) {
+		writearr<u32>(bios_data, i * 4, hle_vectors[i]);
+	}
+	for (int i = 0; i < 6; i++) {
+		writearr<u32>(bios_data, HLE_IRQ_HANDLER + i * 4, hle_irq_handler[i]);
+	}
+
+	fprintf(stderr, "bios: no bios image, using the built-in stub\n");
+}
+
+static u32 &reg(int i)
+{
+	return *cpu.get_reg(i);
+}
+
+/* the estimated cost of the call being serviced, charged once it returns */
+static u64 call_cycles;
+
+static void charge(u64 n)
+{
+	call_cycles += n;
+}
+
+/*
+ * The routines access memory without advancing cpu_cycles, so their side
+ * effects all happen at the time of the SWI; what the access would have
+ * cost on the bus goes into call_cycles instead.
+ */
+template<typename T> static void charge_access(addr_t addr)
+{
+	int width_index = sizeof(T) == sizeof(u32) ? 2 : sizeof(T) == sizeof(u16) ? 1 : 0;
+	int region = addr < 0x1000'0000 ? addr_to_region[addr >> 24] : MemoryRegion::UNUSED;
+
+	if (region == MemoryRegion::CARTRIDGE || region == MemoryRegion::EEPROM) {
+		int ws = ((addr >> 24) - 8) / 2 % 3;
+		charge(cartridge_cycles[ws][SEQ][width_index]);
+	} else {
+		charge(waitstate_cycles[region][width_index]);
+	}
+}
+
+static u32 load32(addr_t addr)
+{
+	charge_access<u32>(addr);
+	return read<u32, FROM_CPU, NOCYCLES>(addr & ~3);
+}
+
+static u16 load16(addr_t addr)
+{
+	charge_access<u16>(addr);
+	return read<u16, FROM_CPU, NOCYCLES>(addr & ~1);
+}
+
+static u8 load8(addr_t addr)
+{
+	charge_access<u8>(addr);
+	return read<u8, FROM_CPU, NOCYCLES>(addr);
+}
+
+static void store32(addr_t addr, u32 data)
+{
+	charge_access<u32>(addr);
+	write<u32, FROM_CPU, NOCYCLES>(addr & ~3, data);
+}
+
+static void store16(addr_t addr, u16 data)
+{
+	charge_access<u16>(addr);
+	write<u16, FROM_CPU, NOCYCLES>(addr & ~1, data);
+}
+
+static void store8(addr_t addr, u8 data)
+{
+	charge_access<u8>(addr);
+	write<u8, FROM_CPU, NOCYCLES>(addr, data);
+}
+
+/* multiplies with 32-bit wraparound like the ARM does */
+static s32 mul(s32 a, s32 b)
+{
+	return (s32)((u32)a * (u32)b);
+}
+
+static void soft_reset()
+{
+	bool to_ewram = iwram_data[0x7FFA];
+
+	std::fill(iwram_data + 0x7E00, iwram_data + IWRAM_SIZE, 0);
+
+	cpu.CPSR = 0x1F;
+	cpu.flag_op = FLAGS_CPSR;
+	cpu.update_mode();
+
+	ZERO_ARR(cpu.r);
+	ZERO_ARR(cpu.SPSR);
+	ZERO_ARR(cpu.banked_lr);
+	ZERO_ARR(cpu.banked_r8_r12);
+	for (int i = 0; i < NUM_BANKS; i++) {
+		cpu.banked_sp[i] = 0x03007F00;
+	}
+	cpu.banked_sp[SUPERVISOR] = 0x03007FE0;
+	cpu.banked_sp[IRQ] = 0x03007FA0;
+	cpu.r[13] = 0x03007F00;
+
+	WRITE_PC(to_ewram ? EWRAM_START : CARTRIDGE_START);
+}
+
+static void clear_io(addr_t start, addr_t end)
+{
+	for (addr_t addr = start; addr < end; addr += 2) {
+		write<u16, ALLOW_ALL, NOCYCLES>(addr, 0);
+	}
+}
+
+static void register_ram_reset(u32 flags)
+{
+	if (flags & BIT(0)) {
+		ZERO_ARR(ewram_data);
+		charge(EWRAM_SIZE / 4 * waitstate_cycles[MemoryRegion::EWRAM][2]);
+	}
+	if (flags & BIT(1)) {
+		std::fill(iwram_data, iwram_data + 0x7E00, 0);
+		charge(0x7E00 / 4);
+	}
+	if (flags & BIT(2)) {
+		ZERO_ARR(palette_data);
+		charge(PALETTE_RAM_SIZE / 4 * waitstate_cycles[MemoryRegion::PALETTE_RAM][2]);
+	}
+	if (flags & BIT(3)) {
+		ZERO_ARR(vram_data);
+		charge(VRAM_SIZE / 4 * waitstate_cycles[MemoryRegion::VRAM][2]);
+	}
+	if (flags & BIT(4)) {
+		ZERO_ARR(oam_data);
+		charge(OAM_SIZE / 4);
+	}
+	if (flags & BIT(5)) {
+		clear_io(0x0400'0120, 0x0400'0130);
+		write<u16, ALLOW_ALL, NOCYCLES>(0x0400'0134, 0x8000);
+	}
+	if (flags & BIT(6)) {
+		clear_io(0x0400'0060, 0x0400'00B0);
+	}
+	if (flags & BIT(7)) {
+		clear_io(0x0400'0000, 0x0400'0060);
+		clear_io(0x0400'00B0, 0x0400'0110);
+		write<u16, ALLOW_ALL, NOCYCLES>(IO_IE, 0);
+		write<u16, ALLOW_ALL, NOCYCLES>(IO_IF, 0xFFFF);
+		write<u16, ALLOW_ALL, NOCYCLES>(IO_WAITCNT, 0);
+		write<u16, ALLOW_ALL, NOCYCLES>(IO_IME, 0);
+	}
+
+	write<u16, ALLOW_ALL, NOCYCLES>(IO_DISPCNT, 0x80);
+}
+
+/*
+ * IntrWait is serviced by halting with the PC pointing back at the SWI, so
+ * the user IRQ handler runs on wake-up and the SWI then checks the flags it
+ * set again. in_intr_wait keeps the initial discard from being repeated.
+ */
+static bool intr_wait(bool discard, u16 mask)
+{
+	if ((cpu.CPSR & IRQ_DISABLE) && bios_loaded) {
+		return false;
+	}
+
+	write<u16, FROM_CPU, NOCYCLES>(IO_IME, 1);
+
+	u16 flags = readarr<u16>(iwram_data, BIOS_IRQ_FLAGS);
+
+	if (discard && !cpu.in_intr_wait) {
+		flags &= ~mask;
+	} else if (flags & mask) {
+		writearr<u16>(iwram_data, BIOS_IRQ_FLAGS, flags & ~mask);
+		cpu.in_intr_wait = false;
+		return true;
+	}
+
+	writearr<u16>(iwram_data, BIOS_IRQ_FLAGS, flags);
+	cpu.in_intr_wait = true;
+	cpu.halted = true;
+	WRITE_PC(cpu.r[15] - (cpu.in_thumb_state() ? 4 : 8));
+	return true;
+}
+
+static void divide(s32 num, s32 den)
+{
+	s32 q;
+	s32 r;
+
+	if (den == 0) {
+		/* the BIOS never returns from this, answer something sane instead */
+		q = num < 0 ? -1 : 1;
+		r = num;
+	} else if (den == -1 && num == INT32_MIN) {
+		q = INT32_MIN;
+		r = 0;
+	} else {
+		q = num / den;
+		r = num % den;
+	}
+
+	reg(0) = q;
+	reg(1) = r;
+	reg(3) = q < 0 ? -(u32)q : q;
+
+	charge(20 + 4 * std::bit_width(reg(3)));
+}
+
+static u16 square_root(u32 x)
+{
+	u32 res = 0;
+	u32 bit = 1u << 30;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+
+	while (bit) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return res;
+}
+
+/* the polynomial the BIOS evaluates, input and output in 1.14 fixed point */
+static s16 arctan(s32 i)
+{
+	s32 a = -(mul(i, i) >> 14);
+	s32 b = (mul(0xA9, a) >> 14) + 0x390;
+	b = (mul(b, a) >> 14) + 0x91C;
+	b = (mul(b, a) >> 14) + 0xFB6;
+	b = (mul(b, a) >> 14) + 0x16AA;
+	b = (mul(b, a) >> 14) + 0x2081;
+	b = (mul(b, a) >> 14) + 0x3651;
+	b = (mul(b, a) >> 14) + 0xA2F9;
+
+	charge(60);
+	return mul(i, b) >> 16;
+}
+
+static u16 arctan2(s32 x, s32 y)
+{
+	if (y == 0) {
+		return x >= 0 ? 0 : 0x8000;
+	}
+	if (x == 0) {
+		return y >= 0 ? 0x4000 : 0xC000;
+	}
+
+	if (y >= 0) {
+		if (x >= 0) {
+			if (x >= y) {
+				return arctan((y << 14) / x);
+			}
+		} else if (-x >= y) {
+			return arctan((y << 14) / x) + 0x8000;
+		}
+		return 0x4000 - arctan((x << 14) / y);
+	}
+
+	if (x <= 0) {
+		if (-x > -y) {
+			return arctan((y << 14) / x) + 0x8000;
+		}
+	} else if (x >= -y) {
+		return arctan((y << 14) / x) + 0x10000;
+	}
+	return 0xC000 - arctan((x << 14) / y);
+}
+
+static void cpu_set(u32 src, u32 dst, u32 control)
+{
+	u32 n = control & BITMASK(21);
+	bool fill = control & BIT(24);
+
+	/* the BIOS refuses to copy out of its own ROM */
+	if (!(src & 0x0E00'0000)) {
+		return;
+	}
+
+	if (control & BIT(26)) {
+		u32 x = fill ? load32(src) : 0;
+		for (u32 i = 0; i < n; i++) {
+			if (!fill) {
+				x = load32(src + i * 4);
+			}
+			store32(dst + i * 4, x);
+		}
+	} else {
+		u16 x = fill ? load16(src) : 0;
+		for (u32 i = 0; i < n; i++) {
+			if (!fill) {
+				x = load16(src + i * 2);
+			}
+			store16(dst + i * 2, x);
+		}
+	}
+
+	/* loop overhead of the BIOS copy, which runs from zero wait state ROM */
+	charge(n * 3);
+}
+
+static void cpu_fast_set(u32 src, u32 dst, u32 control)
+{
+	u32 n = ((control & BITMASK(21)) + 7) & ~7;
+	bool fill = control & BIT(24);
+
+	if (!(src & 0x0E00'0000)) {
+		return;
+	}
+
+	u32 x = fill ? load32(src) : 0;
+	for (u32 i = 0; i < n; i++) {
+		if (!fill) {
+			x = load32(src + i * 4);
+		}
+		store32(dst + i * 4, x);
+	}
+
+	charge(n / 8 * 6);
+}
+
+static void init_sine_lut()
+{
+	if (sine_lut[64]) {
+		return;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		sine_lut[i] = std::lround(std::sin(i * std::numbers::pi / 128) * 0x4000);
+	}
+}
+
+static void bg_affine_set(u32 src, u32 dst, u32 n)
+{
+	init_sine_lut();
+
+	for (u32 i = 0; i < n; i++, src += 20, dst += 16) {
+		s32 ox = load32(src);
+		s32 oy = load32(src + 4);
+		s16 cx = load16(src + 8);
+		s16 cy = load16(src + 10);
+		s16 sx = load16(src + 12);
+		s16 sy = load16(src + 14);
+		u8 theta = load16(src + 16) >> 8;
+
+		s32 sine = sine_lut[theta];
+		s32 cosine = sine_lut[(u8)(theta + 64)];
+
+		s16 pa = (sx * cosine) >> 14;
+		s16 pb = (-sx * sine) >> 14;
+		s16 pc = (sy * sine) >> 14;
+		s16 pd = (sy * cosine) >> 14;
+
+		store16(dst, pa);
+		store16(dst + 2, pb);
+		store16(dst + 4, pc);
+		store16(dst + 6, pd);
+		store32(dst + 8, ox - (pa * cx + pb * cy));
+		store32(dst + 12, oy - (pc * cx + pd * cy));
+
+		charge(40);
+	}
+}
+
+static void obj_affine_set(u32 src, u32 dst, u32 n, u32 stride)
+{
+	init_sine_lut();
+
+	for (u32 i = 0; i < n; i++, src += 8, dst += stride * 4) {
+		s16 sx = load16(src);
+		s16 sy = load16(src + 2);
+		u8 theta = load16(src + 4) >> 8;
+
+		s32 sine = sine_lut[theta];
+		s32 cosine = sine_lut[(u8)(theta + 64)];
+
+		store16(dst, (sx * cosine) >> 14);
+		store16(dst + stride, (-sx * sine) >> 14);
+		store16(dst + stride * 2, (sy * sine) >> 14);
+		store16(dst + stride * 3, (sy * cosine) >> 14);
+
+		charge(30);
+	}
+}
+
+static void bit_unpack(u32 src, u32 dst, u32 info)
+{
+	u16 len = load16(info);
+	int src_width = load8(info + 2);
+	int dst_width = load8(info + 3);
+	u32 offset = load32(info + 4);
+	bool offset_zero = offset & BIT(31);
+	offset &= BITMASK(31);
+
+	if (!std::has_single_bit((u32)src_width) || src_width > 8 || !std::has_single_bit((u32)dst_width) || dst_width > 32) {
+		return;
+	}
+
+	u32 out = 0;
+	int out_bits = 0;
+
+	for (u32 i = 0; i < len; i++) {
+		u8 b = load8(src + i);
+		for (int bit = 0; bit < 8; bit += src_width) {
+			u32 x = b >> bit & BITMASK(src_width);
+			if (x || offset_zero) {
+				x += offset;
+			}
+			if (dst_width < 32) {
+				x &= BITMASK(dst_width);
+			}
+			out |= x << out_bits;
+			out_bits += dst_width;
+			if (out_bits == 32) {
+				store32(dst, out);
+				dst += 4;
+				out = 0;
+				out_bits = 0;
+			}
+		}
+		charge(4);
+	}
+}
+
+/* decompressed data goes out in bytes for WRAM, in halfwords for VRAM */
+static void write_output(u32 dst, const std::vector<u8> &out, bool vram)
+{
+	if (vram) {
+		for (std::size_t i = 0; i < out.size(); i += 2) {
+			u16 x = out[i];
+			if (i + 1 < out.size()) {
+				x |= out[i + 1] << 8;
+			}
+			store16(dst + i, x);
+		}
+	} else {
+		for (std::size_t i = 0; i < out.size(); i++) {
+			store8(dst + i, out[i]);
+		}
+	}
+}
+
+static void lz77_uncomp(u32 src, u32 dst, bool vram)
+{
+	u32 size = load32(src) >> 8;
+	std::vector<u8> out;
+	out.reserve(size);
+	src += 4;
+
+	while (out.size() < size) {
+		u8 flags = load8(src++);
+		for (int i = 0; i < 8 && out.size() < size; i++, flags <<= 1) {
+			if (!(flags & 0x80)) {
+				out.push_back(load8(src++));
+				continue;
+			}
+
+			u8 b0 = load8(src++);
+			u8 b1 = load8(src++);
+			u32 len = (b0 >> 4) + 3;
+			u32 disp = ((b0 & 0xF) << 8 | b1) + 1;
+
+			for (u32 j = 0; j < len && out.size() < size; j++) {
+				out.push_back(disp <= out.size() ? out[out.size() - disp] : 0);
+			}
+			charge(len);
+		}
+		charge(8);
+	}
+
+	write_output(dst, out, vram);
+}
+
+static void huff_uncomp(u32 src, u32 dst)
+{
+	u32 header = load32(src);
+	u32 size = header >> 8;
+	int data_bits = header & 0xF;
+
+	if (data_bits != 4 && data_bits != 8) {
+		return;
+	}
+
+	u32 tree = src + 4;
+	u32 root = tree + 1;
+	u32 stream = tree + (load8(tree) + 1) * 2;
+
+	u32 node_addr = root;
+	u8 node = load8(root);
+	u32 out = 0;
+	int out_bits = 0;
+	u32 written = 0;
+
+	while (written < size) {
+		u32 bits = load32(stream);
+		stream += 4;
+
+		for (int i = 31; i >= 0 && written < size; i--) {
+			int dir = bits >> i & 1;
+			u32 next = (node_addr & ~1) + (node & 0x3F) * 2 + 2 + dir;
+
+			if (node & (dir ? 0x40 : 0x80)) {
+				out |= (load8(next) & BITMASK(data_bits)) << out_bits;
+				out_bits += data_bits;
+				if (out_bits == 32) {
+					store32(dst + written, out);
+					written += 4;
+					out = 0;
+					out_bits = 0;
+				}
+				node_addr = root;
+				node = load8(root);
+			} else {
+				node_addr = next;
+				node = load8(next);
+			}
+		}
+		charge(32 * 3);
+	}
+}
+
+static void rl_uncomp(u32 src, u32 dst, bool vram)
+{
+	u32 size = load32(src) >> 8;
+	std::vector<u8> out;
+	out.reserve(size);
+	src += 4;
+
+	while (out.size() < size) {
+		u8 flag = load8(src++);
+		if (flag & 0x80) {
+			u32 len = (flag & 0x7F) + 3;
+			u8 x = load8(src++);
+			for (u32 j = 0; j < len && out.size() < size; j++) {
+				out.push_back(x);
+			}
+			charge(len);
+		} else {
+			u32 len = (flag & 0x7F) + 1;
+			for (u32 j = 0; j < len && out.size() < size; j++) {
+				out.push_back(load8(src++));
+			}
+			charge(len);
+		}
+	}
+
+	write_output(dst, out, vram);
+}
+
+static void diff8_unfilter(u32 src, u32 dst, bool vram)
+{
+	u32 size = load32(src) >> 8;
+	std::vector<u8> out(size);
+	src += 4;
+
+	u8 x = 0;
+	for (u32 i = 0; i < size; i++) {
+		x += load8(src + i);
+		out[i] = x;
+	}
+	charge(size * 3);
+
+	write_output(dst, out, vram);
+}
+
+static void diff16_unfilter(u32 src, u32 dst)
+{
+	u32 size = load32(src) >> 8;
+	src += 4;
+
+	u16 x = 0;
+	for (u32 i = 0; i < size; i += 2) {
+		x += load16(src + i);
+		store16(dst + i, x);
+	}
+	charge(size / 2 * 3);
+}
+
+static void sound_bias(bool on)
+{
+	u16 bias = io_read<u16>(IO_SOUNDBIAS) & ~0x3FE;
+	if (on) {
+		bias |= 0x200;
+	}
+	write<u16, FROM_CPU, NOCYCLES>(IO_SOUNDBIAS, bias);
+}
+
+static bool dispatch(u32 comment)
+{
+	switch (comment) {
+		case SWI_SOFT_RESET:
+			if (bios_loaded) {
+				return false;
+			}
+			soft_reset();
+			break;
+		case SWI_REGISTER_RAM_RESET:
+			register_ram_reset(reg(0));
+			break;
+		case SWI_HALT:
+		case SWI_STOP:
+			/* stop mode is not emulated, wait like Halt */
+			cpu.halted = true;
+			break;
+		case SWI_INTR_WAIT:
+			return intr_wait(reg(0), reg(1));
+		case SWI_VBLANK_INTR_WAIT:
+			reg(0) = 1;
+			reg(1) = IRQ_VBLANK;
+			return intr_wait(true, IRQ_VBLANK);
+		case SWI_DIV:
+			divide(reg(0), reg(1));
+			break;
+		case SWI_DIV_ARM:
+			divide(reg(1), reg(0));
+			charge(3);
+			break;
+		case SWI_SQRT:
+			reg(0) = square_root(reg(0));
+			charge(80);
+			break;
+		case SWI_ARCTAN:
+			reg(0) = (s32)arctan((s32)reg(0));
+			break;
+		case SWI_ARCTAN2:
+			reg(0) = arctan2((s16)reg(0), (s16)reg(1));
+			break;
+		case SWI_CPU_SET:
+			cpu_set(reg(0), reg(1), reg(2));
+			break;
+		case SWI_CPU_FAST_SET:
+			cpu_fast_set(reg(0), reg(1), reg(2));
+			break;
+		case SWI_GET_BIOS_CHECKSUM:
+			reg(0) = 0xBAAE187F;
+			break;
+		case SWI_BG_AFFINE_SET:
+			bg_affine_set(reg(0), reg(1), reg(2));
+			break;
+		case SWI_OBJ_AFFINE_SET:
+			obj_affine_set(reg(0), reg(1), reg(2), reg(3));
+			break;
+		case SWI_BIT_UNPACK:
+			bit_unpack(reg(0), reg(1), reg(2));
+			break;
+		case SWI_LZ77_UNCOMP_WRAM:
+		case SWI_LZ77_UNCOMP_VRAM:
+			lz77_uncomp(reg(0), reg(1), comment == SWI_LZ77_UNCOMP_VRAM);
+			break;
+		case SWI_HUFF_UNCOMP:
+			huff_uncomp(reg(0), reg(1));
+			break;
+		case SWI_RL_UNCOMP_WRAM:
+		case SWI_RL_UNCOMP_VRAM:
+			rl_uncomp(reg(0), reg(1), comment == SWI_RL_UNCOMP_VRAM);
+			break;
+		case SWI_DIFF8_UNFILTER_WRAM:
+		case SWI_DIFF8_UNFILTER_VRAM:
+			diff8_unfilter(reg(0), reg(1), comment == SWI_DIFF8_UNFILTER_VRAM);
+			break;
+		case SWI_DIFF16_UNFILTER:
+			diff16_unfilter(reg(0), reg(1));
+			break;
+		case SWI_SOUND_BIAS:
+			sound_bias(reg(0));
+			break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Called by the SWI instructions with the comment field. Returns false if the
+ * call should go through the BIOS vector instead. A call takes effect at once,
+ * at the time of the SWI, and the time it took is handed to the CPU, which
+ * passes over it in steps that stop at every event.
+ */
+bool bios_call(u32 comment)
+{
+	call_cycles = 0;
+
+	if (!dispatch(comment)) {
+		if (!bios_loaded) {
+			static bool warned[256];
+			if (!warned[comment]) {
+				warned[comment] = true;
+				fprintf(stderr, "bios: swi 0x%02X is not implemented without a bios image\n", comment);
+			}
+		}
+		return false;
+	}
+
+	charge(BIOS_CALL_CYCLES);
+	cpu.bios_cycles += call_cycles;
+	if (prefetch_enabled) {
+		prefetch.step(call_cycles);
+	}
+
+	last_bios_opcode = BIOS_SWI_RETURN_OPCODE;
+	return true;
+}
@@ -0,0 +1,132 @@
+#include <gba/blip.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+typedef std::array<std::array<s32, BLIP_WIDTH>, BLIP_PHASES> blip_kernel_t;
+
+/*
+ * Blackman-windowed sinc with a cutoff just below the output Nyquist
+ * frequency, one row per sub-sample phase. Every row sums to exactly
+ * 1 << BLIP_KERNEL_BITS so a delta never leaves a DC error behind.
+ */
+static blip_kernel_t make_kernel()
+{
+	constexpr double cutoff = 0.45;
+	constexpr double pi = 3.14159265358979323846;
+
+	blip_kernel_t kernel;
+
+	for (int p = 0; p < BLIP_PHASES; p++) {
+		double center = BLIP_WIDTH / 2 - 1 + (double)p / BLIP_PHASES;
+		double h[BLIP_WIDTH];
+		double total = 0;
+
+		for (int i = 0; i < BLIP_WIDTH; i++) {
+			double x = i - center;
+			double s = x == 0 ? 1 : std::sin(2 * pi * cutoff * x) / (2 * pi * cutoff * x);
+			double w = 0.42 + 0.5 * std::cos(pi * x / (BLIP_WIDTH / 2)) + 0.08 * std::cos(2 * pi * x / (BLIP_WIDTH / 2));
+			h[i] = s * w;
+			total += h[i];
+		}
+
+		s32 sum = 0;
+		int largest = 0;
+		for (int i = 0; i < BLIP_WIDTH; i++) {
+			kernel[p][i] = std::lround(h[i] / total * (1 << BLIP_KERNEL_BITS));
+			sum += kernel[p][i];
+			if (kernel[p][i] > kernel[p][largest]) {
+				largest = i;
+			}
+		}
+
+		kernel[p][largest] += (1 << BLIP_KERNEL_BITS) - sum;
+	}
+
+	return kernel;
+}
+
+static const blip_kernel_t blip_kernel = make_kernel();
+
+void BlipBuffer::set_rates(u32 clock_rate, u32 sample_rate)
+{
+	factor = ((u64)sample_rate << 32) / clock_rate;
+}
+
+void BlipBuffer::clear()
+{
+	offset = 0;
+	ZERO_ARR(integrator);
+	std::memset(buffer, 0, sizeof(buffer));
+}
+
+/* t is in clock cycles since the start of the current frame */
+void BlipBuffer::add_delta(u32 t, s32 left, s32 right)
+{
+	u64 pos = offset + t * factor;
+	u32 index = pos >> 32;
+	int phase = pos >> (32 - BLIP_PHASE_BITS) & (BLIP_PHASES - 1);
+
+	if (index + BLIP_WIDTH > BLIP_BUFFER_SIZE) {
+		return;
+	}
+
+	auto &k = blip_kernel[phase];
+	s32 (*out)[2] = buffer + index;
+	s32 rest_left = left;
+	s32 rest_right = right;
+
+	for (int i = 0; i < BLIP_WIDTH - 1; i++) {
+		s32 l = (s64)left * k[i] >> BLIP_KERNEL_BITS;
+		s32 r = (s64)right * k[i] >> BLIP_KERNEL_BITS;
+		out[i][0] += l;
+		out[i][1] += r;
+		rest_left -= l;
+		rest_right -= r;
+	}
+
+	out[BLIP_WIDTH - 1][0] += rest_left;
+	out[BLIP_WIDTH - 1][1] += rest_right;
+}
+
+/* ends the current frame t clock cycles after it started */
+void BlipBuffer::end_frame(u32 t)
+{
+	offset += t * factor;
+}
+
+int BlipBuffer::samples_available()
+{
+	return offset >> 32;
+}
+
+/* reads up to n interleaved stereo sample pairs */
+int BlipBuffer::read_samples(s16 *out, int n)
+{
+	n = at_most(n, samples_available());
+
+	for (int side = 0; side < 2; side++) {
+		s32 sum = integrator[side];
+
+		for (int i = 0; i < n; i++) {
+			sum += buffer[i][side];
+
+			s32 s = sum >> BLIP_SAMPLE_BITS;
+			out[i * 2 + side] = std::clamp(s, -32768, 32767);
+
+			/* slow high-pass to remove the DC offset of the unipolar PSG channels */
+			sum -= sum >> BLIP_BASS_SHIFT;
+		}
+
+		integrator[side] = sum;
+	}
+
+	int remaining = BLIP_BUFFER_SIZE - n;
+	std::memmove(buffer, buffer + n, remaining * sizeof(*buffer));
+	std::memset(buffer + remaining, 0, n * sizeof(*buffer));
+	offset -= (u64)n << 32;
+
+	return n;
+}
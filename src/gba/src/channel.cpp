@@ -1,6 +1,8 @@
 #include <gba/channel.h>
 #include <gba/memory.h>
 #include <gba/scheduler.h>
+#include <gba/apu.h>
+#include <gba/emulator.h>
 
 const int WAVE_DUTY_TABLE[4][8] = {
 	{0, 0, 0, 0, 0, 0, 0, 1},
@@ -35,34 +37,6 @@ template<int ch> void set_freq_timer()
 	}
 }
 
-template<int ch> void step_psg_channel()
-{
-	auto &state = channel_states[ch-1];
-
-	state.freq_timer -= elapsed;
-
-	if (state.freq_timer <= 0) {
-		int surplus = -state.freq_timer;
-
-		set_freq_timer<ch>();
-		state.freq_timer += surplus;
-		state.wave_pos++;
-
-		if constexpr (ch == 4) {
-			u16 &lfsr = noise_state.LFSR;
-			int xor_result = (lfsr & 1) ^ (lfsr >> 1 & 1);
-			lfsr = (lfsr >> 1) | (xor_result << 14);
-
-			if (GET_FLAG(io_read<u8>(IO_SOUND4CNT_H), NOISE_WIDTH)) {
-				lfsr &= ~(1 << 6);
-				lfsr |= xor_result << 6;
-			}
-		}
-	}
-
-	schedule_after(state.freq_timer);
-}
-
 template<int ch> int get_psg_value()
 {
 	auto &state = channel_states[ch-1];
@@ -83,12 +57,6 @@ template<int ch> int get_psg_value()
 			} else {
 				value = sample & BITMASK(4);
 			}
-
-			if (state.wave_pos == 31) {
-				if (GET_FLAG(cntl, WAVE_DIM)) {
-					io_data[IO_SOUND3CNT_L - IO_START] ^= BIT(6);
-				}
-			}
 		} else {
 			value = 0;
 		}
@@ -99,6 +67,80 @@ template<int ch> int get_psg_value()
 	return value;
 }
 
+/* advances the waveform position, and the LFSR for the noise channel, by n steps */
+template<int ch> void step_waveform(u32 n)
+{
+	auto &state = channel_states[ch-1];
+
+	if constexpr (ch == 3) {
+		/* in two-bank mode the playing bank flips every time the position wraps */
+		u8 cntl = io_read<u8>(IO_SOUND3CNT_L);
+		u32 wraps = (state.wave_pos % 32 + n) / 32;
+		if (GET_FLAG(cntl, WAVE_DIM) && wraps % 2 == 1) {
+			io_data[IO_SOUND3CNT_L - IO_START] ^= BIT(6);
+		}
+	}
+
+	state.wave_pos += n;
+
+	if constexpr (ch == 4) {
+		u16 &lfsr = noise_state.LFSR;
+		bool width_7 = GET_FLAG(io_read<u8>(IO_SOUND4CNT_H), NOISE_WIDTH);
+
+		for (u32 i = 0; i < n; i++) {
+			int xor_result = (lfsr & 1) ^ (lfsr >> 1 & 1);
+			lfsr = (lfsr >> 1) | (xor_result << 14);
+
+			if (width_7) {
+				lfsr &= ~(1 << 6);
+				lfsr |= xor_result << 6;
+			}
+		}
+	}
+}
+
+/*
+ * Channels are not stepped by the scheduler. They are brought up to date from
+ * the elapsed cycles whenever the mix changes or the frame ends. Every step of
+ * an audible channel is sent to the APU at its exact cycle; a channel that
+ * cannot be heard skips ahead in one go.
+ */
+template<int ch> void update_psg_channel()
+{
+	auto &state = channel_states[ch-1];
+
+	u64 now = current_time();
+
+	if (!state.enabled || !emu.audio_enabled) {
+		u64 dt = now - state.last_update;
+		state.last_update = now;
+
+		if (dt < (u64)state.freq_timer) {
+			state.freq_timer -= dt;
+			return;
+		}
+
+		u64 surplus = dt - state.freq_timer;
+
+		set_freq_timer<ch>();
+		u32 period = state.freq_timer;
+
+		state.freq_timer = period - surplus % period;
+		step_waveform<ch>(1 + surplus / period);
+		return;
+	}
+
+	while (now - state.last_update >= (u64)state.freq_timer) {
+		state.last_update += state.freq_timer;
+		set_freq_timer<ch>();
+		step_waveform<ch>(1);
+		apu.on_psg_step(ch, state.last_update, get_psg_value<ch>());
+	}
+
+	state.freq_timer -= now - state.last_update;
+	state.last_update = now;
+}
+
 template<int ch> void clock_envelope_ch()
 {
 	auto &state = channel_states[ch-1];
@@ -203,6 +245,7 @@ template<int ch> void trigger_ch()
 	}
 
 	state.wave_pos = 0;
+	state.last_update = current_time();
 	set_freq_timer<ch>();
 }
 
@@ -244,9 +287,9 @@ void SweepState::do_sweep_clock()
 					shadow_freq = new_freq;
 					u16 freqcnt = io_read<u16>(IO_SOUND1CNT_X);
 					SET_FLAG(freqcnt, SOUND_FREQ, new_freq);
+					update_psg_channel<1>();
 					io_write<u16>(IO_SOUND1CNT_X, freqcnt);
 					set_freq_timer<1>();
-					schedule_after(channel_states[0].freq_timer);
 
 					calculate_freq();
 				}
@@ -284,17 +327,12 @@ int get_psg_value(int ch)
 	}
 }
 
-void step_psg(int ch)
+void psg_update()
 {
-	if (ch == 1) {
-		step_psg_channel<1>();
-	} else if (ch == 2) {
-		step_psg_channel<2>();
-	} else if (ch == 3) {
-		step_psg_channel<3>();
-	} else {
-		step_psg_channel<4>();
-	}
+	update_psg_channel<1>();
+	update_psg_channel<2>();
+	update_psg_channel<3>();
+	update_psg_channel<4>();
 }
 
 void psg_clock_length(int ch)
@@ -5,6 +5,8 @@
 #include <gba/scheduler.h>
 
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 
 struct CPU cpu;
@@ -15,21 +17,29 @@ void CPU::reset()
 
 void CPU::fakeboot()
 {
-	registers[0][0] = 0x0800'0000;
-	registers[0][1] = 0xEA;
-	pc = CARTRIDGE_START;
+	r[0] = 0x0800'0000;
+	r[1] = 0xEA;
+	r[15] = CARTRIDGE_START;
 	CPSR = 0x6000'001F;
-	for (int i = 0; i < NUM_MODES; i++) {
-		registers[i][13] = 0x03007F00;
+	flag_op = FLAGS_CPSR;
+	update_mode();
+	for (int i = 0; i < NUM_BANKS; i++) {
+		banked_sp[i] = 0x03007F00;
 	}
+	banked_sp[SUPERVISOR] = 0x03007FE0;
+	banked_sp[IRQ] = 0x03007FA0;
+	r[13] = banked_sp[mode_bank(cpu_mode)];
+
+	/* left behind by the BIOS boot sequence */
+	io_write<u16>(IO_SOUNDBIAS, 0x200);
 }
 
 void CPU::flush_pipeline()
 {
 	if (in_thumb_state()) {
-		pc -= 2;
+		r[15] -= 2;
 	} else {
-		pc -= 4;
+		r[15] -= 4;
 	}
 	nfetch();
 	sfetch();
@@ -37,6 +47,15 @@ void CPU::flush_pipeline()
 
 void CPU::step()
 {
+	PROFILE_SCOPE(PROFILE_CPU);
+
+	if (bios_cycles) [[unlikely]] {
+		u64 n = std::min(bios_cycles, next_event - cpu_cycles);
+		cpu_cycles += n;
+		bios_cycles -= n;
+		return;
+	}
+
 	u16 inter_enable = io_read<u16>(IO_IE) & BITMASK(14);
 	u16 inter_flag = io_read<u16>(IO_IF) & BITMASK(14);
 
@@ -52,13 +71,15 @@ void CPU::step()
 
 	if (!(CPSR & IRQ_DISABLE) && (io_read<u8>(IO_IME) & 1)) {
 		if (inter_enable & inter_flag) {
-			registers[IRQ][14] = pc - (in_thumb_state() ? 4 : 8) + 4;
+			u32 lr = r[15] - (in_thumb_state() ? 4 : 8) + 4;
+			materialize_flags();
 			SPSR[IRQ] = CPSR;
 			CPSR = (CPSR & ~BITMASK(5)) | 0x12;
 			update_mode();
+			r[14] = lr;
 			set_flag(T_STATE, 0);
 			set_flag(IRQ_DISABLE, 1);
-			pc = VECTOR_IRQ;
+			r[15] = VECTOR_IRQ;
 			flush_pipeline();
 			sfetch();
 		}
@@ -69,34 +90,34 @@ void CPU::step()
 
 void CPU::arm_nfetch()
 {
-	pc += 4;
+	r[15] += 4;
 	pipeline[0] = pipeline[1];
 	pipeline[1] = pipeline[2];
-	pipeline[2] = read<u32, FROM_FETCH, NSEQ>(pc);
+	pipeline[2] = read<u32, FROM_FETCH, NSEQ>(r[15]);
 }
 
 void CPU::arm_sfetch()
 {
-	pc += 4;
+	r[15] += 4;
 	pipeline[0] = pipeline[1];
 	pipeline[1] = pipeline[2];
-	pipeline[2] = read<u32, FROM_FETCH, SEQ>(pc);
+	pipeline[2] = read<u32, FROM_FETCH, SEQ>(r[15]);
 }
 
 void CPU::thumb_nfetch()
 {
-	pc += 2;
+	r[15] += 2;
 	pipeline[0] = pipeline[1];
 	pipeline[1] = pipeline[2];
-	pipeline[2] = read<u16, FROM_FETCH, NSEQ>(pc);
+	pipeline[2] = read<u16, FROM_FETCH, NSEQ>(r[15]);
 }
 
 void CPU::thumb_sfetch()
 {
-	pc += 2;
+	r[15] += 2;
 	pipeline[0] = pipeline[1];
 	pipeline[1] = pipeline[2];
-	pipeline[2] = read<u16, FROM_FETCH, SEQ>(pc);
+	pipeline[2] = read<u16, FROM_FETCH, SEQ>(r[15]);
 }
 
 void CPU::nfetch()
@@ -137,15 +158,17 @@ void CPU::thumb_execute()
 
 bool CPU::cond_triggered(const u32 cond)
 {
+	if (cond == 0xE) [[likely]] {
+		return true;
+	}
+
+	materialize_flags();
+
 	const bool N = CPSR & SIGN_FLAG;
 	const bool Z = CPSR & ZERO_FLAG;
 	const bool C = CPSR & CARRY_FLAG;
 	const bool V = CPSR & OVERFLOW_FLAG;
 
-	if (cond == 0xE) [[likely]] {
-		return true;
-	}
-
 	switch (cond) {
 		case 0:
 			return Z;
@@ -183,7 +206,7 @@ bool CPU::cond_triggered(const u32 cond)
 void CPU::arm_execute()
 {
 	u32 op = pipeline[0];
-	if (pc < BIOS_END) {
+	if (r[15] < BIOS_END) {
 		last_bios_opcode = pipeline[2];
 	}
 
@@ -203,8 +226,8 @@ void CPU::arm_execute()
 
 void CPU::switch_mode(cpu_mode_t new_mode)
 {
-	int src = cpu_mode;
-	int dst = new_mode;
+	int src = mode_bank(cpu_mode);
+	int dst = mode_bank(new_mode);
 
 	cpu_mode = new_mode;
 
@@ -212,29 +235,25 @@ void CPU::switch_mode(cpu_mode_t new_mode)
 		return;
 	}
 
-	for (int i = 0; i < 8; i++) {
-		registers[0][i] = registers[src][i];
-		registers[dst][i] = registers[0][i];
-	}
+	banked_sp[src] = r[13];
+	banked_lr[src] = r[14];
+	r[13] = banked_sp[dst];
+	r[14] = banked_lr[dst];
 
-	if (src != FIQ) {
-		for (int i = 8; i < 13; i++) {
-			registers[0][i] = registers[src][i];
-		}
-	}
-	if (dst != FIQ) {
-		for (int i = 8; i < 13; i++) {
-			registers[dst][i] = registers[0][i];
-		}
+	if ((src == FIQ) != (dst == FIQ)) {
+		std::memcpy(banked_r8_r12[src == FIQ], &r[8], sizeof(banked_r8_r12[0]));
+		std::memcpy(&r[8], banked_r8_r12[dst == FIQ], sizeof(banked_r8_r12[0]));
 	}
 }
 
 void CPU::exception_prologue(cpu_mode_t mode, u8 flag)
 {
-	registers[mode][14] = pc - (in_thumb_state() ? 2 : 4);
+	u32 lr = r[15] - (in_thumb_state() ? 2 : 4);
+	materialize_flags();
 	SPSR[mode] = CPSR;
 	CPSR = (CPSR & ~BITMASK(5)) | flag;
 	update_mode();
+	r[14] = lr;
 	set_flag(T_STATE, 0);
 	set_flag(IRQ_DISABLE, 1);
 }
@@ -272,12 +291,18 @@ void CPU::update_mode()
 	switch_mode(new_mode);
 }
 
-u32 *CPU::get_reg(int i)
+/* the user mode view of register i, for LDM/STM with the S bit set */
+u32 *CPU::get_user_reg(int i)
 {
-	if (i == 15) {
-		return &pc;
+	int bank = mode_bank(cpu_mode);
+
+	if (8 <= i && i < 13 && bank == FIQ) {
+		return &banked_r8_r12[0][i - 8];
+	}
+	if (13 <= i && i < 15 && bank != SYSTEM) {
+		return i == 13 ? &banked_sp[SYSTEM] : &banked_lr[SYSTEM];
 	}
-	return &registers[cpu_mode][i];
+	return &r[i];
 }
 
 u32 *CPU::get_spsr()
@@ -288,16 +313,6 @@ u32 *CPU::get_spsr()
 	return &SPSR[cpu_mode];
 }
 
-u32 *CPU::get_sp()
-{
-	return &registers[cpu_mode][13];
-}
-
-u32 *CPU::get_lr()
-{
-	return &registers[cpu_mode][14];
-}
-
 void CPU::set_flag(u32 flag, bool x)
 {
 	if (x) {
@@ -307,6 +322,31 @@ void CPU::set_flag(u32 flag, bool x)
 	}
 }
 
+/* write the lazily evaluated flags back into CPSR */
+void CPU::materialize_flags()
+{
+	if (flag_op == FLAGS_CPSR) {
+		return;
+	}
+
+	u32 flags = 0;
+	if (flag_result & BIT(31)) {
+		flags |= SIGN_FLAG;
+	}
+	if (flag_result == 0) {
+		flags |= ZERO_FLAG;
+	}
+	if (get_carry()) {
+		flags |= CARRY_FLAG;
+	}
+	if (get_overflow()) {
+		flags |= OVERFLOW_FLAG;
+	}
+
+	CPSR = (CPSR & ~NZCV_MASK) | flags;
+	flag_op = FLAGS_CPSR;
+}
+
 bool CPU::in_thumb_state()
 {
 	return CPSR & T_STATE;
@@ -326,15 +366,16 @@ void CPU::dump_registers()
 {
 
 	for (int i = 0; i < 15; i++) {
-		fprintf(stderr, "%08X ", registers[cpu_mode % NUM_MODES][i]);
+		fprintf(stderr, "%08X ", r[i]);
 	}
 
 	if (in_thumb_state()) {
-		fprintf(stderr, "%08X ", pc - 2);
+		fprintf(stderr, "%08X ", r[15] - 2);
 	} else {
-		fprintf(stderr, "%08X ", pc - 4);
+		fprintf(stderr, "%08X ", r[15] - 4);
 	}
 
+	materialize_flags();
 	fprintf(stderr, "cpsr: %08X |", CPSR);
 }
 
@@ -5,6 +5,7 @@
 
 #include <bit>
 #include <iostream>
+#include <algorithm>
 
 static const int sad_offset[4] = {1, -1, 0, 1}; // last value is invalid but dont want to segfault
 static const int dad_offset[4] = {1, -1, 0, 1};
@@ -13,9 +14,13 @@ DMA dma;
 
 void DMA::step()
 {
+	PROFILE_SCOPE(PROFILE_DMA);
+
 	channel = std::countr_zero(dma_active);
 
-	step_channel(channel);
+	if (!burst_channel(channel) && !eeprom_channel(channel)) {
+		step_channel(channel);
+	}
 }
 
 void DMA::step_channel(int ch)
@@ -68,26 +73,276 @@ void DMA::step_channel(int ch)
 	t.count++;
 
 	if (t.count >= t.cnt_l) {
-		cpu_cycles += 1;
-		t.count = 0;
-		if (GET_FLAG(t.cnt_h, DMA_SEND_IRQ)) {
-			request_interrupt(IRQ_DMA0 * BIT(ch));
-		}
+		end_transfer(ch);
+	}
+}
 
-		if (GET_FLAG(t.cnt_h, DMA_REPEAT) && GET_FLAG(t.cnt_h, DMA_TRIGGER) != DMA_TRIGGER_NOW) {
-			t.cnt_l = load_cnt_l(ch);
-			if (destcnt == 3) {
-				t.dad = align(load_dad(ch), width);
+/*
+ * Host pointer to addr if all n units of a transfer starting there and moving
+ * by delta lie in one contiguous stretch of memory without side effects, or
+ * nullptr if the transfer has to go through the bus.
+ */
+static u8 *burst_span(addr_t addr, int width, int delta, u32 n, bool is_dest)
+{
+	addr_t last = addr + (n - 1) * width * delta;
+	addr_t lo = std::min(addr, last);
+	addr_t hi = std::max(addr, last) + width - 1;
+
+	if (hi >= 0x1000'0000 || lo >> 24 != hi >> 24) {
+		return nullptr;
+	}
+
+	int region = addr_to_region[addr >> 24];
+	switch (region) {
+		case MemoryRegion::EWRAM:
+		case MemoryRegion::IWRAM:
+		case MemoryRegion::PALETTE_RAM:
+		case MemoryRegion::VRAM:
+		case MemoryRegion::OAM:
+			break;
+		case MemoryRegion::CARTRIDGE:
+			/* reads only, from the ROM itself, and only while their timing does not depend on the prefetcher */
+			if (is_dest || prefetch_enabled || (hi & region_to_offset_mask[region]) >= cartridge.size) {
+				return nullptr;
 			}
-			if (t.is_special() && (ch == 1 || ch == 2)) {
-				t.cnt_l = 4;
+			break;
+		default:
+			return nullptr;
+	}
+
+	u32 mask = region_to_offset_mask[region];
+	if ((hi & mask) - (lo & mask) != hi - lo) {
+		return nullptr;
+	}
+
+	u32 offset = addr & mask;
+	if (region == MemoryRegion::VRAM) {
+		if ((lo & mask) < 96_KiB && (hi & mask) >= 96_KiB) {
+			return nullptr;
+		}
+		if (offset >= 96_KiB) {
+			offset -= 32_KiB;
+		}
+	}
+
+	u8 *arr = is_dest ? region_to_data_write[region] : region_to_data[region];
+	return arr ? arr + offset : nullptr;
+}
+
+/*
+ * Copies as many units of the transfer on ch as run before the next event in
+ * one go, with the same timing as stepping them one by one. Only done when
+ * both ends are plain memory; returns false if ch has to be stepped instead.
+ */
+bool DMA::burst_channel(int ch)
+{
+	auto &t = transfers[ch];
+
+	int width = GET_FLAG(t.cnt_h, DMA_TRANSFER32) ? 4 : 2;
+	int width_index = width == 4 ? 2 : 1;
+
+	int sad_delta = sad_offset[GET_FLAG(t.cnt_h, DMA_SRCCNT)];
+	if (t.sad >= 0x0800'0000 && t.sad < 0x0E00'0000) {
+		sad_delta = 1;
+	}
+	int dad_delta = dad_offset[GET_FLAG(t.cnt_h, DMA_DESTCNT)];
+
+	u32 n = t.cnt_l - t.count;
+	if (n < 2 || t.sad < 0x0200'0000) {
+		return false;
+	}
+
+	u8 *src = burst_span(t.sad, width, sad_delta, n, false);
+	u8 *dst = src ? burst_span(t.dad, width, dad_delta, n, true) : nullptr;
+	if (!dst) {
+		return false;
+	}
+
+	int src_region = addr_to_region[t.sad >> 24];
+	int dst_region = addr_to_region[t.dad >> 24];
+	u32 write_cycles = waitstate_cycles[dst_region][width_index];
+	u32 nseq_cycles;
+	u32 seq_cycles;
+	u32 bus_cycles = write_cycles;
+
+	if (src_region == MemoryRegion::CARTRIDGE) {
+		int ws = ((t.sad >> 24) - 8) / 2 % 3;
+		nseq_cycles = cartridge_cycles[ws][NSEQ][width_index];
+		seq_cycles = cartridge_cycles[ws][SEQ][width_index];
+	} else {
+		nseq_cycles = seq_cycles = waitstate_cycles[src_region][width_index];
+		bus_cycles += seq_cycles;
+	}
+
+	bool trigger_now = GET_FLAG(t.cnt_h, DMA_TRIGGER) == DMA_TRIGGER_NOW;
+	int src_step = width * sad_delta;
+	int dst_step = width * dad_delta;
+	int s = 0;
+	int d = 0;
+	u32 x = 0;
+	u32 done = 0;
+
+	do {
+		bool first = t.count == 0;
+		if (first && trigger_now) {
+			cpu_cycles += 1;
+		}
+
+		if (width == 4) {
+			x = readarr<u32>(src, s);
+			writearr<u32>(dst, d, x);
+		} else {
+			x = readarr<u16>(src, s);
+			writearr<u16>(dst, d, x);
+		}
+		cpu_cycles += (first ? nseq_cycles : seq_cycles) + write_cycles;
+
+		s += src_step;
+		d += dst_step;
+		t.count++;
+		done++;
+	} while (t.count < t.cnt_l && cpu_cycles < next_event);
+
+	if (prefetch_enabled) {
+		prefetch.step(bus_cycles * done);
+	}
+
+	last_value[ch] = width == 4 ? x : x * 0x10001;
+	t.sad += done * src_step;
+	t.dad += done * dst_step;
+
+	if (t.count >= t.cnt_l) {
+		end_transfer(ch);
+	}
+
+	return true;
+}
+
+/*
+ * Feeds a DMA3 transfer to or from the EEPROM straight into its bit-serial
+ * interface, with the memory side accessed through a host pointer and the
+ * same timing as stepping the units through the bus. A whole read request,
+ * read or write stream normally goes through in a single call.
+ */
+bool DMA::eeprom_channel(int ch)
+{
+	auto &t = transfers[ch];
+
+	if (ch != 3 || GET_FLAG(t.cnt_h, DMA_TRANSFER32)) {
+		return false;
+	}
+
+	bool to_eeprom = addr_to_region[t.dad >> 24] == MemoryRegion::EEPROM;
+	if (!to_eeprom && addr_to_region[t.sad >> 24] != MemoryRegion::EEPROM) {
+		return false;
+	}
+
+	int sad_delta = to_eeprom ? sad_offset[GET_FLAG(t.cnt_h, DMA_SRCCNT)] : 1;
+	int dad_delta = dad_offset[GET_FLAG(t.cnt_h, DMA_DESTCNT)];
+	addr_t eeprom_addr = to_eeprom ? t.dad : t.sad;
+	int eeprom_delta = to_eeprom ? dad_delta : sad_delta;
+	addr_t mem_addr = to_eeprom ? t.sad : t.dad;
+	int mem_delta = to_eeprom ? sad_delta : dad_delta;
+
+	u32 n = t.cnt_l - t.count;
+	u32 mask = eeprom.eeprom_mask;
+	addr_t last = eeprom_addr + (n - 1) * 2 * eeprom_delta;
+	if (last >> 24 != eeprom_addr >> 24 || (eeprom_addr & mask) != mask || (last & mask) != mask) {
+		return false;
+	}
+
+	if (mem_addr < 0x0200'0000 || addr_to_region[mem_addr >> 24] == MemoryRegion::CARTRIDGE) {
+		return false;
+	}
+
+	u8 *mem = burst_span(mem_addr, 2, mem_delta, n, !to_eeprom);
+	if (!mem) {
+		return false;
+	}
+
+	u32 mem_cycles = waitstate_cycles[addr_to_region[mem_addr >> 24]][1];
+	int ws = ((eeprom_addr >> 24) - 8) / 2 % 3;
+	bool trigger_now = GET_FLAG(t.cnt_h, DMA_TRIGGER) == DMA_TRIGGER_NOW;
+	int mem_step = 2 * mem_delta;
+	int eeprom_step = 2 * eeprom_delta;
+	int m = 0;
+	u16 x = 0;
+	u32 done = 0;
+
+	do {
+		bool first = t.count == 0;
+		if (first && trigger_now) {
+			cpu_cycles += 1;
+		}
+
+		if (to_eeprom) {
+			x = readarr<u16>(mem, m);
+			cpu_cycles += mem_cycles;
+			if (prefetch_enabled) {
+				prefetch.step(mem_cycles);
 			}
+
+			/* DMA writes are always timed as sequential */
+			eeprom_write(x);
+			cpu_cycles += cartridge_cycles[ws][SEQ][1];
 		} else {
-			io_data[IO_DMA0CNT_H - IO_START + ch*12 + 1] &= ~0x80;
+			x = eeprom_read();
+			if (first) {
+				cartridge_read_cycles<u16, NSEQ>(eeprom_addr);
+			} else {
+				cartridge_read_cycles<u16, SEQ>(eeprom_addr);
+			}
+
+			writearr<u16>(mem, m, x);
+			cpu_cycles += mem_cycles;
+			if (prefetch_enabled) {
+				prefetch.step(mem_cycles);
+			}
 		}
 
-		dma_active &= ~BIT(ch);
+		m += mem_step;
+		eeprom_addr += eeprom_step;
+		t.count++;
+		done++;
+	} while (t.count < t.cnt_l && cpu_cycles < next_event);
+
+	last_value[ch] = x * 0x10001;
+	t.sad += done * 2 * sad_delta;
+	t.dad += done * 2 * dad_delta;
+
+	if (t.count >= t.cnt_l) {
+		end_transfer(ch);
 	}
+
+	return true;
+}
+
+void DMA::end_transfer(int ch)
+{
+	auto &t = transfers[ch];
+
+	int width = GET_FLAG(t.cnt_h, DMA_TRANSFER32) ? 4 : 2;
+	int destcnt = GET_FLAG(t.cnt_h, DMA_DESTCNT);
+
+	cpu_cycles += 1;
+	t.count = 0;
+	if (GET_FLAG(t.cnt_h, DMA_SEND_IRQ)) {
+		request_interrupt(IRQ_DMA0 * BIT(ch));
+	}
+
+	if (GET_FLAG(t.cnt_h, DMA_REPEAT) && GET_FLAG(t.cnt_h, DMA_TRIGGER) != DMA_TRIGGER_NOW) {
+		t.cnt_l = load_cnt_l(ch);
+		if (destcnt == 3) {
+			t.dad = align(load_dad(ch), width);
+		}
+		if (t.is_special() && (ch == 1 || ch == 2)) {
+			t.cnt_l = 4;
+		}
+	} else {
+		io_data[IO_DMA0CNT_H - IO_START + ch*12 + 1] &= ~0x80;
+	}
+
+	dma_active &= ~BIT(ch);
 }
 
 u32 DMA::load_cnt_l(int ch)
@@ -102,6 +102,7 @@ void Eeprom::write(u8 data)
 				u32 offset = address * 8;
 				writearr<u32>(eeprom_memory, offset, bytes);
 				writearr<u32>(eeprom_memory, offset+4, bytes >> 32);
+				save_dirty = true;
 
 				TO(EEPROM_END);
 			}
@@ -126,11 +127,3 @@ void load_eeprom()
 	fprintf(stderr, "eeprom save file: read %ld bytes\n", bytes_read);
 }
 
-void save_eeprom()
-{
-	std::ofstream f(cartridge.save_file, std::ios_base::binary);
-	f.write((char *)eeprom.eeprom_memory, MAX_EEPROM_SIZE);
-
-	fprintf(stderr, "saved eeprom to file: %s\n", cartridge.save_file.c_str());
-}
-
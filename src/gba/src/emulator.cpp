@@ -4,6 +4,9 @@
 #include <gba/dma.h>
 #include <gba/scheduler.h>
 #include <gba/memory.h>
+#include <gba/movie.h>
+#include <gba/bios.h>
+#include <gba/savefile.h>
 
 #include <iostream>
 #include <memory>
@@ -11,7 +14,17 @@
 Arguments args;
 Emulator emu;
 
+static std::unique_ptr<SaveState> run_ahead_state;
+static std::unique_ptr<SaveState> save_slots[NUM_SAVE_SLOTS];
+
 void Emulator::init(Arguments &args)
+{
+	load_rom(args);
+	load_save();
+	boot(args);
+}
+
+void Emulator::load_rom(Arguments &args)
 {
 	set_initial_memory_state();
 
@@ -20,7 +33,11 @@ void Emulator::init(Arguments &args)
 
 	load_cartridge_rom();
 	determine_save_type();
+	update_memory_map();
+}
 
+void Emulator::load_save()
+{
 	switch (cartridge.save_type) {
 		case SAVE_SRAM:
 			load_sram();
@@ -35,18 +52,105 @@ void Emulator::init(Arguments &args)
 			load_eeprom();
 			break;
 	}
+}
 
+void Emulator::boot(Arguments &args)
+{
 	cartridge_loaded = true;
 
+	if (args.write_saves) {
+		save_flusher.start(cartridge.save_file);
+	}
+
+	hle_bios = args.hle_bios;
+	if (hle_bios && !bios_loaded) {
+		install_hle_bios();
+		cpu.fakeboot();
+	}
+
 	cpu.flush_pipeline();
 	cpu.sfetch();
 
-	next_event = CYCLES_PER_SAMPLE;
+	next_event = 0;
 	cpu_cycles = 0;
 }
 
+void Emulator::set_render_interval(int n)
+{
+	if (n != render_interval) {
+		render_interval = at_least(n, 0);
+		render_counter = 0;
+	}
+}
+
+/*
+ * Changes the host sample rate the APU resamples to. Frontends nudge it every
+ * frame to keep their audio queue at a steady level. Movies always run at the
+ * nominal rate so their audio hashes do not depend on the host.
+ */
+void Emulator::set_sample_rate(u32 rate)
+{
+	if (!movie.active()) {
+		apu.set_sample_rate(rate);
+	}
+}
+
+bool Emulator::next_frame_rendered()
+{
+	if (render_interval <= 0) {
+		return false;
+	}
+
+	render_counter = (render_counter + 1) % render_interval;
+	return render_counter == 0;
+}
+
+/*
+ * Runs one frame as seen by the player. With run-ahead enabled the real frame
+ * is emulated without video, then the next frames are emulated with the same
+ * input and without audio, and the last one is presented before rolling back.
+ */
+void Emulator::run_frame()
+{
+	int n = at_most(emu_cnt.run_ahead_frames, MAX_RUN_AHEAD);
+
+	frame_rendered = next_frame_rendered();
+
+	if (n <= 0) {
+		render_enabled = frame_rendered;
+		run_one_frame();
+		render_enabled = true;
+		return;
+	}
+
+	if (!run_ahead_state) {
+		run_ahead_state = std::make_unique<SaveState>();
+	}
+
+	render_enabled = false;
+	run_one_frame();
+
+	save_state(*run_ahead_state);
+	audio_enabled = false;
+	running_ahead = true;
+
+	for (int i = 1; i < n; i++) {
+		run_one_frame();
+	}
+
+	render_enabled = frame_rendered;
+	run_one_frame();
+	render_enabled = true;
+
+	load_state(*run_ahead_state);
+	audio_enabled = true;
+	running_ahead = false;
+}
+
 void Emulator::run_one_frame()
 {
+	PROFILE_SCOPE(PROFILE_SCHEDULER);
+
 	for (;;) {
 		while (cpu_cycles < next_event) {
 			if (dma.dma_active) {
@@ -61,7 +165,6 @@ void Emulator::run_one_frame()
 		dma.update();
 		ppu.step();
 		apu.channel_step();
-		apu.step();
 		timer.step();
 
 		end_event_processing();
@@ -70,33 +173,43 @@ void Emulator::run_one_frame()
 			ppu.vblank = false;
 			ppu.on_vblank();
 			dma.on_vblank();
-			apu.audio_buffer_index = 0;
-			io_write<u16>(IO_KEYINPUT, emu_cnt.joypad_state);
+			int samples = apu.end_frame(audiobuffer, AUDIOBUFFER_SIZE);
+			if (!running_ahead) {
+				audio_samples = samples;
+				save_flusher.on_frame_end();
+			}
+			latch_input();
 			break;
 		}
 	}
 }
 
-void Emulator::close()
+/*
+ * Latches the joypad state into KEYINPUT at VBlank. Only real frames take new
+ * input, which lets a movie record or replace it; run-ahead frames repeat the
+ * last latched state.
+ */
+void Emulator::latch_input()
 {
-	if (cartridge_loaded) {
-		switch (cartridge.save_type) {
-			case SAVE_SRAM:
-				save_sram();
-				break;
-			case SAVE_FLASH64:
-			case SAVE_FLASH128:
-				save_flash();
-				break;
-			case SAVE_EEPROM4:
-			case SAVE_EEPROM64:
-				save_eeprom();
-				break;
-		}
+	if (!running_ahead) {
+		latched_input = movie.on_frame_end(emu_cnt.joypad_state, render_enabled);
 	}
 
+	io_write<u16>(IO_KEYINPUT, latched_input);
+}
+
+void Emulator::close()
+{
+	movie.stop();
+
+	save_flusher.stop();
+
 	reset_memory();
 
+	for (auto &slot : save_slots) {
+		slot.reset();
+	}
+
 	cartridge_loaded = false;
 }
 
@@ -124,7 +237,7 @@ void Emulator::reset_memory()
 	ZERO_ARR(palette_data);
 	ZERO_ARR(vram_data);
 	ZERO_ARR(oam_data);
-	ZERO_ARR(cartridge_data);
+	cartridge.size = 0;
 	ZERO_ARR(sram_data);
 	ZERO_ARR(wave_ram);
 	last_bios_opcode = 0;
@@ -132,6 +245,7 @@ void Emulator::reset_memory()
 	ppu.reset();
 	next_event = 0;
 	elapsed = 0;
+	timestamp = 0;
 	scheduler_flag = false;
 	cpu_cycles = 0;
 	timer = {};
@@ -143,12 +257,110 @@ void Emulator::reset()
 	init(args);
 }
 
+#define SAVE_ARR(a) std::memcpy(s.a, a, sizeof(a))
+#define LOAD_ARR(a) std::memcpy(a, s.a, sizeof(a))
+
+void Emulator::save_state(SaveState &s)
+{
+	s.cpu = cpu;
+	s.dma = dma;
+	s.ppu = ppu;
+	s.apu = apu;
+	SAVE_ARR(fifos);
+	SAVE_ARR(channel_states);
+	s.sweep_state = sweep_state;
+	s.noise_state = noise_state;
+	s.wave_state = wave_state;
+	s.timer = timer;
+	s.prefetch = prefetch;
+	s.flash = flash;
+	s.eeprom = eeprom;
+	s.save_type = cartridge.save_type;
+
+	SAVE_ARR(ewram_data);
+	SAVE_ARR(iwram_data);
+	SAVE_ARR(io_data);
+	SAVE_ARR(palette_data);
+	SAVE_ARR(vram_data);
+	SAVE_ARR(oam_data);
+	SAVE_ARR(sram_data);
+	SAVE_ARR(wave_ram);
+
+	SAVE_ARR(waitstate_cycles);
+	SAVE_ARR(cartridge_cycles);
+	s.last_bios_opcode = last_bios_opcode;
+	s.prefetch_enabled = prefetch_enabled;
+
+	s.next_event = next_event;
+	s.elapsed = elapsed;
+	s.timestamp = timestamp;
+	s.cpu_cycles = cpu_cycles;
+	s.scheduler_flag = scheduler_flag;
+}
+
+void Emulator::load_state(const SaveState &s)
+{
+	cpu = s.cpu;
+	dma = s.dma;
+	ppu = s.ppu;
+	apu = s.apu;
+	LOAD_ARR(fifos);
+	LOAD_ARR(channel_states);
+	sweep_state = s.sweep_state;
+	noise_state = s.noise_state;
+	wave_state = s.wave_state;
+	timer = s.timer;
+	prefetch = s.prefetch;
+	flash = s.flash;
+	eeprom = s.eeprom;
+	cartridge.save_type = s.save_type;
+	update_memory_map();
+
+	LOAD_ARR(ewram_data);
+	LOAD_ARR(iwram_data);
+	LOAD_ARR(io_data);
+	LOAD_ARR(palette_data);
+	LOAD_ARR(vram_data);
+	LOAD_ARR(oam_data);
+	LOAD_ARR(sram_data);
+	LOAD_ARR(wave_ram);
+
+	LOAD_ARR(waitstate_cycles);
+	LOAD_ARR(cartridge_cycles);
+	last_bios_opcode = s.last_bios_opcode;
+	prefetch_enabled = s.prefetch_enabled;
+
+	next_event = s.next_event;
+	elapsed = s.elapsed;
+	timestamp = s.timestamp;
+	cpu_cycles = s.cpu_cycles;
+	scheduler_flag = s.scheduler_flag;
+}
+
+#undef SAVE_ARR
+#undef LOAD_ARR
+
 void emulator_save_state(int n)
 {
+	if (!emu.cartridge_loaded || n < 0 || n >= NUM_SAVE_SLOTS) {
+		return;
+	}
 
+	if (!save_slots[n]) {
+		save_slots[n] = std::make_unique<SaveState>();
+	}
+
+	emu.save_state(*save_slots[n]);
 }
 
 void emulator_load_state(int n)
 {
+	if (!emu.cartridge_loaded || n < 0 || n >= NUM_SAVE_SLOTS || !save_slots[n]) {
+		return;
+	}
+
+	emu.load_state(*save_slots[n]);
 
+	/* the slot carries its own save memory */
+	save_dirty = true;
 }
@@ -51,11 +51,3 @@ void load_flash()
 	fprintf(stderr, "flash save file: read %ld bytes\n", bytes_read);
 }
 
-void save_flash()
-{
-	std::ofstream f(cartridge.save_file, std::ios_base::binary);
-	f.write((char *)flash.flash_memory, MAX_FLASH_SIZE);
-
-	fprintf(stderr, "saved flash to file: %s\n", cartridge.save_file.c_str());
-}
-
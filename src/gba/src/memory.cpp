@@ -4,7 +4,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
-#include <regex>
+#include <cstring>
 
 u8 *const region_to_data[NUM_REGIONS] = {
 	nullptr,
@@ -16,7 +16,8 @@ u8 *const region_to_data[NUM_REGIONS] = {
 	vram_data,
 	oam_data,
 	cartridge_data,
-	sram_data
+	sram_data,
+	cartridge_data
 };
 
 u8 *const region_to_data_write[NUM_REGIONS] = {
@@ -29,10 +30,12 @@ u8 *const region_to_data_write[NUM_REGIONS] = {
 	vram_data,
 	oam_data,
 	nullptr,
-	sram_data
+	sram_data,
+	nullptr
 };
 
-const int addr_to_region[16] = {
+/* the odd gamepak pages are switched to EEPROM by update_memory_map */
+int addr_to_region[16] = {
 	MemoryRegion::BIOS,
 	MemoryRegion::UNUSED,
 	MemoryRegion::EWRAM,
@@ -61,7 +64,8 @@ const u32 region_to_offset_mask[NUM_REGIONS] = {
 	0x1FFFF,
 	0x3FF,
 	0x1FFFFFF,
-	0xFFFF
+	0xFFFF,
+	0x1FFFFFF
 };
 
 Cartridge cartridge;
@@ -88,12 +92,15 @@ u8 waitstate_cycles[NUM_REGIONS][3] = {
 	{1, 1, 2},
 	{1, 1, 1},
 	{5, 5, 8},
-	{5, 5, 5}
+	{5, 5, 5},
+	{5, 5, 8}
 };
 u8 cartridge_cycles[3][2][3];
 
 u32 last_bios_opcode;
+bool bios_loaded;
 bool prefetch_enabled;
+bool save_dirty;
 
 
 void request_interrupt(u16 flag)
@@ -105,10 +112,6 @@ void request_interrupt(u16 flag)
 
 void set_initial_memory_state()
 {
-	for (u32 i = 0; i < CARTRIDGE_SIZE; i += 2) {
-		writearr<u16>(cartridge_data, i, i / 2 & 0xFFFF);
-	}
-
 	for (u32 i = 0; i < SRAM_SIZE; i++) {
 		sram_data[i] = 0xFF;
 	}
@@ -151,29 +154,59 @@ void load_bios_rom(const std::string &filename)
 		throw std::runtime_error("ERROR while reading bios file");
 	}
 
+	bios_loaded = true;
 	fprintf(stderr, "bios: read %ld bytes\n", bytes_read);
 }
 
+struct SaveTypeId {
+	const char *prefix;
+	std::size_t length;
+	int save_type;
+};
+
+static const SaveTypeId save_type_ids[] = {
+	{"SRAM", 4, SAVE_SRAM},
+	{"FLASH", 5, SAVE_FLASH64},
+	{"FLASH512", 8, SAVE_FLASH64},
+	{"FLASH1M", 7, SAVE_FLASH128},
+	{"EEPROM", 6, SAVE_EEPROM_UNKNOWN}
+};
+
+static bool is_digit(u8 c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/*
+ * Looks for the first save library ID ("SRAM_Vnnn", "FLASH1M_Vnnn", ...) in
+ * the ROM in one pass. Every ID ends in "_Vnnn" and no prefix contains an
+ * underscore, so IDs turn up in the order they start in when the scan only
+ * stops at underscores.
+ */
 void determine_save_type()
 {
-	std::regex r("SRAM_V\\d\\d\\d|FLASH_V\\d\\d\\d|FLASH512_V\\d\\d\\d|FLASH1M_V\\d\\d\\d|EEPROM_V\\d\\d\\d");
-	std::cmatch m;
-
-	if (std::regex_search((const char *)cartridge_data, (const char *)cartridge_data+cartridge.size, m, r)) {
-		fprintf(stderr, "detected save type -- %s\n", m[0].str().c_str());
-		cartridge.save_type_known = true;
-
-		if (m[0].str().starts_with("SRAM")) {
-			cartridge.save_type = SAVE_SRAM;
-		} else if (m[0].str().starts_with("FLASH_") || m[0].str().starts_with("FLASH5")) {
-			cartridge.save_type = SAVE_FLASH64;
-		} else if (m[0].str().starts_with("FLASH1")) {
-			cartridge.save_type = SAVE_FLASH128;
-		} else if (m[0].str().starts_with("EEPROM")) {
-			cartridge.save_type = SAVE_EEPROM_UNKNOWN;
+	const u8 *begin = cartridge_data;
+	const u8 *end = cartridge_data + cartridge.size;
+	const u8 *p = begin;
+
+	while ((p = (const u8 *)std::memchr(p, '_', end - p)) != nullptr) {
+		const u8 *underscore = p++;
+
+		if (end - underscore < 5 || underscore[1] != 'V' || !is_digit(underscore[2]) || !is_digit(underscore[3]) || !is_digit(underscore[4])) {
+			continue;
 		}
 
-		return;
+		for (auto &id : save_type_ids) {
+			if ((std::size_t)(underscore - begin) < id.length || std::memcmp(underscore - id.length, id.prefix, id.length) != 0) {
+				continue;
+			}
+
+			std::string match((const char *)underscore - id.length, id.length + 5);
+			fprintf(stderr, "detected save type -- %s\n", match.c_str());
+			cartridge.save_type_known = true;
+			cartridge.save_type = id.save_type;
+			return;
+		}
 	}
 }
 
@@ -187,14 +220,6 @@ void load_sram()
 	fprintf(stderr, "sram save file: read %ld bytes\n", bytes_read);
 }
 
-void save_sram()
-{
-	std::ofstream f(cartridge.save_file, std::ios_base::binary);
-	f.write((char *)sram_data, SRAM_SIZE);
-
-	fprintf(stderr, "saved sram to file: %s\n", cartridge.save_file.c_str());
-}
-
 bool in_vram_bg(u32 offset) {
 	bool bitmap_mode = (io_data[0] & 0x7) >= 3;
 	if (bitmap_mode) {
@@ -287,6 +312,19 @@ void Prefetch::init(addr_t addr)
 	size = 0;
 }
 
+/*
+ * An EEPROM answers on gamepak addresses with bit 24 set, so only the odd
+ * pages need the address check; the rest stay plain ROM reads.
+ */
+void update_memory_map()
+{
+	int region = is_eeprom() ? MemoryRegion::EEPROM : MemoryRegion::CARTRIDGE;
+
+	for (int page = 0x9; page <= 0xD; page += 2) {
+		addr_to_region[page] = region;
+	}
+}
+
 bool is_eeprom()
 {
 	return cartridge.save_type == SAVE_EEPROM_UNKNOWN || cartridge.save_type == SAVE_EEPROM4 || cartridge.save_type == SAVE_EEPROM64;
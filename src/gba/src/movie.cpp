@@ -0,0 +1,236 @@
+#include <gba/movie.h>
+#include <gba/emulator.h>
+#include <gba/memory.h>
+#include <gba/bios.h>
+#include <gba/ppu.h>
+#include <common/hash.h>
+#include <platform/common/platform.h>
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<SaveState>, "SaveState is written to movies as raw bytes");
+
+Movie movie;
+
+u64 hash_rom()
+{
+	return xxhash64(cartridge_data, cartridge.size);
+}
+
+/* HLE runs differ from the same BIOS run natively, so they hash differently */
+u64 hash_bios()
+{
+	return xxhash64(bios_data, BIOS_SIZE, hle_bios);
+}
+
+/* hashes the composed frame, so the output format and color correction do not matter */
+u64 hash_frame_output(bool video)
+{
+	u64 h = 0;
+	if (video) {
+		h = xxhash64(composed_frame, sizeof(composed_frame));
+	}
+
+	return xxhash64(audiobuffer, emu.audio_samples * sizeof(*audiobuffer), h);
+}
+
+bool Movie::start_recording()
+{
+	if (!emu.cartridge_loaded) {
+		return false;
+	}
+
+	rom_hash = hash_rom();
+	bios_hash = hash_bios();
+	rom_name = std::filesystem::path(cartridge.filename).filename().string();
+
+	apu.set_sample_rate(SAMPLE_RATE);
+
+	initial_state = std::make_unique<SaveState>();
+	emu.save_state(*initial_state);
+
+	frames.clear();
+	frame_index = 0;
+	mode = MOVIE_RECORDING;
+
+	fprintf(stderr, "movie: recording started\n");
+	return true;
+}
+
+bool Movie::start_playback()
+{
+	if (!emu.cartridge_loaded || !initial_state) {
+		return false;
+	}
+
+	if (rom_hash != hash_rom()) {
+		fprintf(stderr, "movie: recorded against a different rom (%s)\n", rom_name.c_str());
+		return false;
+	}
+
+	if (bios_hash != hash_bios()) {
+		fprintf(stderr, "movie: recorded against a different bios\n");
+		return false;
+	}
+
+	emu.load_state(*initial_state);
+
+	frame_index = 0;
+	mismatches = 0;
+	first_mismatch = 0;
+	mode = MOVIE_PLAYBACK;
+
+	fprintf(stderr, "movie: playing back %zu frames\n", frames.size());
+	return true;
+}
+
+void Movie::stop()
+{
+	if (mode == MOVIE_RECORDING) {
+		fprintf(stderr, "movie: recorded %zu frames\n", frames.size());
+	} else if (mode == MOVIE_PLAYBACK) {
+		fprintf(stderr, "movie: played back %zu frames, %zu mismatches\n", frame_index, mismatches);
+	}
+
+	mode = MOVIE_NONE;
+}
+
+bool Movie::active()
+{
+	return mode != MOVIE_NONE;
+}
+
+/*
+ * Called once per real (not run-ahead) frame at VBlank, right before the
+ * joypad state is latched. Returns the joypad state to latch.
+ */
+u16 Movie::on_frame_end(u16 joypad_state, bool video)
+{
+	if (mode == MOVIE_RECORDING) {
+		u8 flags = video ? MOVIE_FRAME_VIDEO : 0;
+		frames.push_back({joypad_state, flags, hash_frame_output(video)});
+	} else if (mode == MOVIE_PLAYBACK) {
+		if (frame_index >= frames.size()) {
+			stop();
+			return joypad_state;
+		}
+
+		auto &f = frames[frame_index];
+		bool recorded_video = f.flags & MOVIE_FRAME_VIDEO;
+
+		if (!recorded_video || video) {
+			if (f.hash != hash_frame_output(recorded_video)) {
+				if (mismatches == 0) {
+					first_mismatch = frame_index;
+					fprintf(stderr, "movie: output differs from recording at frame %zu\n", frame_index);
+				}
+				mismatches++;
+			}
+		}
+
+		frame_index++;
+		joypad_state = f.joypad_state;
+	}
+
+	return joypad_state;
+}
+
+template<typename T> static void write_value(std::ofstream &f, T x)
+{
+	f.write((const char *)&x, sizeof(x));
+}
+
+template<typename T> static void read_value(std::ifstream &f, T &x)
+{
+	f.read((char *)&x, sizeof(x));
+}
+
+bool Movie::save(const std::string &filename)
+{
+	if (!initial_state) {
+		return false;
+	}
+
+	std::ofstream f(filename, std::ios_base::binary);
+
+	f.write(MOVIE_MAGIC, 8);
+	write_value<u32>(f, MOVIE_VERSION);
+	write_value<u32>(f, sizeof(SaveState));
+	write_value<u64>(f, rom_hash);
+	write_value<u64>(f, bios_hash);
+	write_value<u32>(f, rom_name.size());
+	f.write(rom_name.data(), rom_name.size());
+	write_value<u32>(f, frames.size());
+
+	f.write((const char *)initial_state.get(), sizeof(SaveState));
+
+	for (auto &x : frames) {
+		write_value<u16>(f, x.joypad_state);
+		write_value<u8>(f, x.flags);
+		write_value<u64>(f, x.hash);
+	}
+
+	if (!f.good()) {
+		fprintf(stderr, "movie: error writing %s\n", filename.c_str());
+		return false;
+	}
+
+	fprintf(stderr, "movie: saved %zu frames to %s\n", frames.size(), filename.c_str());
+	return true;
+}
+
+bool Movie::load(const std::string &filename)
+{
+	std::ifstream f(filename, std::ios_base::binary);
+
+	char magic[8]{};
+	u32 version = 0;
+	u32 state_size = 0;
+	u32 name_size = 0;
+	u32 frame_count = 0;
+
+	f.read(magic, 8);
+	read_value(f, version);
+	read_value(f, state_size);
+
+	if (!f.good() || std::memcmp(magic, MOVIE_MAGIC, 8) != 0) {
+		fprintf(stderr, "movie: %s is not a movie file\n", filename.c_str());
+		return false;
+	}
+
+	if (version != MOVIE_VERSION || state_size != sizeof(SaveState)) {
+		fprintf(stderr, "movie: %s was recorded by an incompatible version\n", filename.c_str());
+		return false;
+	}
+
+	read_value(f, rom_hash);
+	read_value(f, bios_hash);
+	read_value(f, name_size);
+	rom_name.resize(name_size);
+	f.read(rom_name.data(), name_size);
+	read_value(f, frame_count);
+
+	initial_state = std::make_unique<SaveState>();
+	f.read((char *)initial_state.get(), sizeof(SaveState));
+
+	frames.resize(frame_count);
+	for (auto &x : frames) {
+		read_value(f, x.joypad_state);
+		read_value(f, x.flags);
+		read_value(f, x.hash);
+	}
+
+	if (!f.good()) {
+		fprintf(stderr, "movie: %s is truncated\n", filename.c_str());
+		initial_state.reset();
+		frames.clear();
+		return false;
+	}
+
+	mode = MOVIE_NONE;
+	return true;
+}
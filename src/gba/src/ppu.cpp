@@ -2,11 +2,13 @@
 #include <gba/memory.h>
 #include <gba/scheduler.h>
 #include <gba/dma.h>
+#include <gba/emulator.h>
 
 #include <utility>
 #include <algorithm>
 #include <cstring>
 #include <vector>
+#include <cmath>
 
 static const u8 OBJ_REGULAR_WIDTH[3][4] = {
 	{8, 16, 32, 64},
@@ -28,6 +30,20 @@ static const int BG_AFFINE_HEIGHT[4] = {128, 256, 512, 1024};
 
 PPU ppu;
 
+/* scanline scratch buffers, kept out of PPU so that it stays cheap to snapshot */
+static pixel_info bufferA[FRAMEBUFFER_SIZE];
+static pixel_info bufferB[FRAMEBUFFER_SIZE];
+static pixel_info obj_buffer[FRAMEBUFFER_SIZE];
+static bool obj_window[LCD_WIDTH];
+
+static void output_scanline(int ly, const u16 *line);
+
+int output_format = OUTPUT_BGR555;
+bool output_color_correction;
+u16 composed_frame[FRAMEBUFFER_SIZE];
+static u32 output_lut[0x8000];
+static bool output_lut_identity = true;
+
 #define SET_AND_REQ_IRQ(x) \
 	if (DISPSTAT() & LCD_##x##_IRQ) {\
 		request_interrupt(IRQ_##x);\
@@ -36,6 +52,8 @@ PPU ppu;
 
 void PPU::step()
 {
+	PROFILE_SCOPE(PROFILE_PPU);
+
 	cycles += elapsed;
 
 	if (cycles < 960) {
@@ -125,9 +143,22 @@ void PPU::copy_affine_ref()
 	ref_y[1] = (s32)(io_read<u32>(IO_BG3Y_L) << 4) >> 4;
 }
 
+void PPU::step_affine_ref()
+{
+	ref_x[0] += (s32)(s16)io_read<u16>(IO_BG2PB);
+	ref_y[0] += (s32)(s16)io_read<u16>(IO_BG2PD);
+	ref_x[1] += (s32)(s16)io_read<u16>(IO_BG3PB);
+	ref_y[1] += (s32)(s16)io_read<u16>(IO_BG2PD);
+}
+
 void PPU::on_hblank()
 {
-	draw_scanline();
+	if (emu.render_enabled) {
+		draw_scanline();
+	} else if (GET_FLAG(io_read<u16>(IO_DISPCNT), LCD_BGMODE) <= 5) {
+		/* keep the affine reference points moving exactly as draw_scanline would */
+		step_affine_ref();
+	}
 	dma.on_hblank();
 }
 
@@ -217,8 +248,9 @@ void PPU::draw_scanline()
 	u8 bldy = io_read<u8>(IO_BLDY);
 	int evy = at_most(GET_FLAG(bldy, BLEND_EVY), 16);
 
+	u16 *composed_line = composed_frame + ly * LCD_WIDTH;
 	u16 color;
-	for (u32 i = ly * LCD_WIDTH, j = 0; j < LCD_WIDTH; j++, framebuffer[i++] = color) {
+	for (u32 i = ly * LCD_WIDTH, j = 0; j < LCD_WIDTH; i++, composed_line[j++] = color) {
 		auto &a = bufferA[i];
 		auto &b = bufferB[i];
 
@@ -249,10 +281,81 @@ void PPU::draw_scanline()
 		DO_BLEND(DEC);
 	}
 
-	ref_x[0] += (s32)(s16)io_read<u16>(IO_BG2PB);
-	ref_y[0] += (s32)(s16)io_read<u16>(IO_BG2PD);
-	ref_x[1] += (s32)(s16)io_read<u16>(IO_BG3PB);
-	ref_y[1] += (s32)(s16)io_read<u16>(IO_BG2PD);
+	output_scanline(ly, composed_line);
+
+	step_affine_ref();
+}
+
+/* writes a composed line of BGR555 colors to framebuffer in the output format */
+static void output_scanline(int ly, const u16 *line)
+{
+	if (output_format == OUTPUT_XRGB8888) {
+		u32 *out = (u32 *)framebuffer + ly * LCD_WIDTH;
+		for ITERATE_LINE {
+			out[j] = output_lut[line[j] & 0x7FFF];
+		}
+	} else if (output_lut_identity) {
+		std::memcpy((u16 *)framebuffer + ly * LCD_WIDTH, line, LCD_WIDTH * sizeof(*line));
+	} else {
+		u16 *out = (u16 *)framebuffer + ly * LCD_WIDTH;
+		for ITERATE_LINE {
+			out[j] = output_lut[line[j] & 0x7FFF];
+		}
+	}
+}
+
+/*
+ * Approximates the colors of the GBA's LCD, which is darker and less
+ * saturated than a PC monitor: the input is linearized with a steep gamma,
+ * the channels are mixed into each other and the result is re-encoded for
+ * the host.
+ */
+static void correct_color(double &r, double &g, double &b)
+{
+	constexpr double lcd_gamma = 4.0;
+	constexpr double out_gamma = 2.2;
+
+	double lr = std::pow(r, lcd_gamma);
+	double lg = std::pow(g, lcd_gamma);
+	double lb = std::pow(b, lcd_gamma);
+
+	r = std::pow((0 * lb + 50 * lg + 255 * lr) / 255, 1 / out_gamma) * 255 / 280;
+	g = std::pow((30 * lb + 230 * lg + 10 * lr) / 255, 1 / out_gamma) * 255 / 280;
+	b = std::pow((220 * lb + 10 * lg + 50 * lr) / 255, 1 / out_gamma) * 255 / 280;
+}
+
+void set_output_format(int format, bool color_correction)
+{
+	output_format = format;
+	output_color_correction = color_correction;
+	output_lut_identity = format == OUTPUT_BGR555 && !color_correction;
+
+	for (u32 c = 0; c < 0x8000; c++) {
+		double r = GET_FLAG(c, COLOR_R) / 31.0;
+		double g = GET_FLAG(c, COLOR_G) / 31.0;
+		double b = GET_FLAG(c, COLOR_B) / 31.0;
+
+		if (color_correction) {
+			correct_color(r, g, b);
+		}
+
+		switch (format) {
+			case OUTPUT_BGR555:
+				output_lut[c] = std::lround(r * 31) | std::lround(g * 31) << 5 | std::lround(b * 31) << 10;
+				break;
+			case OUTPUT_RGB565:
+				output_lut[c] = std::lround(r * 31) << 11 | std::lround(g * 63) << 5 | std::lround(b * 31);
+				break;
+			case OUTPUT_XRGB8888:
+				output_lut[c] = 0xFF00'0000 | std::lround(r * 255) << 16 | std::lround(g * 255) << 8 | std::lround(b * 255);
+				break;
+		}
+	}
+}
+
+int output_pixel_size()
+{
+	return output_format == OUTPUT_XRGB8888 ? sizeof(u32) : sizeof(u16);
 }
 
 void PPU::setup_windows()
@@ -440,7 +543,7 @@ bg_reg_sc_block_start:
 		}
 
 		for (px = pstart; px != pend; px += pdelta, j++) {
-			if (j > LCD_WIDTH) {
+			if (j >= LCD_WIDTH) {
 				return;
 			}
 
@@ -0,0 +1,16 @@
+#include <gba/profile.h>
+
+const char *profile_section_names[NUM_PROFILE_SECTIONS] = {
+	"other",
+	"scheduler",
+	"cpu",
+	"memory",
+	"ppu",
+	"apu",
+	"dma",
+	"timer"
+};
+
+#ifdef GBAFLARE_PROFILE
+volatile std::sig_atomic_t profile_section = PROFILE_OTHER;
+#endif
@@ -0,0 +1,167 @@
+#include <gba/savefile.h>
+#include <gba/memory.h>
+#include <gba/flash.h>
+#include <gba/eeprom.h>
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+SaveFlusher save_flusher;
+
+/*
+ * The save memory backing the cartridge's save type, empty while there is none.
+ * An EEPROM of unknown size stays untouched until its size is known, so it
+ * only ever compares equal to the memory loaded at startup.
+ */
+static std::pair<const u8 *, std::size_t> save_memory()
+{
+	switch (cartridge.save_type) {
+		case SAVE_SRAM:
+			return {sram_data, SRAM_SIZE};
+		case SAVE_FLASH64:
+		case SAVE_FLASH128:
+			return {flash.flash_memory, MAX_FLASH_SIZE};
+		case SAVE_EEPROM_UNKNOWN:
+		case SAVE_EEPROM4:
+		case SAVE_EEPROM64:
+			return {eeprom.eeprom_memory, MAX_EEPROM_SIZE};
+	}
+
+	return {nullptr, 0};
+}
+
+/* writes a sibling temporary file, syncs it and renames it over the target */
+bool write_file_atomic(const std::string &filename, const u8 *data, std::size_t size)
+{
+	std::string temp_filename = filename + ".tmp";
+
+	FILE *f = std::fopen(temp_filename.c_str(), "wb");
+	if (!f) {
+		fprintf(stderr, "could not open %s\n", temp_filename.c_str());
+		return false;
+	}
+
+	bool ok = std::fwrite(data, 1, size, f) == size && std::fflush(f) == 0;
+#ifdef __unix__
+	ok = ok && fsync(fileno(f)) == 0;
+#endif
+	ok = std::fclose(f) == 0 && ok;
+
+	if (ok) {
+#if defined (_WIN64) || defined (_WIN32)
+		/* rename does not replace an existing file here */
+		std::remove(filename.c_str());
+#endif
+		ok = std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+	}
+
+	if (!ok) {
+		fprintf(stderr, "could not write %s\n", filename.c_str());
+		std::remove(temp_filename.c_str());
+	}
+
+	return ok;
+}
+
+SaveFlusher::~SaveFlusher()
+{
+	stop();
+}
+
+/* the save memory as loaded counts as written, so an untouched save is never rewritten */
+void SaveFlusher::start(const std::string &filename)
+{
+	stop();
+
+	this->filename = filename;
+	auto [data, size] = save_memory();
+	written.assign(data, data + size);
+	save_dirty = false;
+	changed = false;
+	idle_frames = 0;
+	has_pending = false;
+	stopping = false;
+
+	writer = std::thread(&SaveFlusher::run, this);
+}
+
+bool SaveFlusher::active()
+{
+	return writer.joinable();
+}
+
+void SaveFlusher::on_frame_end()
+{
+	if (!active()) {
+		return;
+	}
+
+	if (save_dirty) {
+		save_dirty = false;
+		changed = true;
+		idle_frames = 0;
+	} else if (changed && ++idle_frames >= SAVE_FLUSH_DELAY) {
+		changed = false;
+		submit();
+	}
+}
+
+/* hands the writer a snapshot if the save memory differs from what was last written */
+void SaveFlusher::submit()
+{
+	auto [data, size] = save_memory();
+	if (size == 0 || (written.size() == size && std::memcmp(written.data(), data, size) == 0)) {
+		return;
+	}
+
+	written.assign(data, data + size);
+
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		pending = written;
+		has_pending = true;
+	}
+	wake.notify_one();
+}
+
+/* flushes whatever changed since the last write and waits for the writer */
+void SaveFlusher::stop()
+{
+	if (!active()) {
+		return;
+	}
+
+	submit();
+
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+void SaveFlusher::run()
+{
+	std::vector<u8> data;
+
+	for (;;) {
+		std::unique_lock<std::mutex> lk(lock);
+		wake.wait(lk, [&] { return stopping || has_pending; });
+		if (!has_pending) {
+			return;
+		}
+		data.swap(pending);
+		has_pending = false;
+		lk.unlock();
+
+		if (write_file_atomic(filename, data.data(), data.size())) {
+			fprintf(stderr, "saved battery save to file: %s\n", filename.c_str());
+		}
+	}
+}
@@ -3,6 +3,7 @@
 u64 cpu_cycles;
 u64 next_event;
 u64 elapsed;
+u64 timestamp;
 bool scheduler_flag = true;
 
 void schedule_event(u64 t)
@@ -23,6 +24,7 @@ void start_event_processing()
 {
 	scheduler_flag = true;
 	elapsed = cpu_cycles;
+	timestamp += elapsed;
 	cpu_cycles = 0;
 }
 
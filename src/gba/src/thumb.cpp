@@ -2,6 +2,7 @@
 #include <gba/cpu.h>
 #include <gba/ops.h>
 #include <gba/memory.h>
+#include <gba/bios.h>
 
 #include <bit>
 #include <iostream>
@@ -33,7 +34,7 @@ void thumb_branch_cond(u16 op)
 	s8 imm = op & BITMASK(8);
 
 	if (cpu.cond_triggered(cond)) {
-		WRITE_PC(cpu.pc + (s32)imm * 2);
+		WRITE_PC(cpu.r[15] + (s32)imm * 2);
 	}
 	cpu.sfetch();
 }
@@ -45,13 +46,13 @@ void thumb_branch(u16 op)
 	s32 nn = (s32)(imm << 21) >> 21;
 
 	if constexpr (h == 0) {
-		WRITE_PC(cpu.pc + nn * 2);
+		WRITE_PC(cpu.r[15] + nn * 2);
 	} else if constexpr (h == 2) {
 		u32 *lr = cpu.get_lr();
-		*lr = cpu.pc + (nn << 12);
+		*lr = cpu.r[15] + (nn << 12);
 	} else if constexpr (h == 3) {
 		u32 *lr = cpu.get_lr();
-		u32 old_pc = cpu.pc;
+		u32 old_pc = cpu.r[15];
 		WRITE_PC(*lr + imm * 2);
 		*lr = (old_pc - 2) | 1;
 	}
@@ -77,17 +78,13 @@ void thumb_shift_reg(u16 op)
 
 	BARREL_SHIFTER(*rd, C);
 
-	u32 r = *rd;
-	NZ_FLAGS_RD;
-	WRITE_CPU_FLAGS;
+	cpu.set_logic_flags(*rd, C);
 	cpu.sfetch();
 }
 
 template <u32 aluop>
 void thumb_addsub(u16 op)
 {
-	GET_CPU_FLAGS;
-
 	u32 operand;
 
 	u32 *rd = cpu.get_reg(op & BITMASK(3));
@@ -99,50 +96,39 @@ void thumb_addsub(u16 op)
 		operand = op >> 6 & BITMASK(3);
 	}
 
-	u32 r;
 	if constexpr (aluop == 0 || aluop == 2) {
-		u64 result = (u64)rn + operand;
-		r = *rd = result;
-		CV_FLAGS_ADD;
+		u32 r = *rd = rn + operand;
+		cpu.set_add_flags(rn, operand, r);
 	} else if constexpr (aluop == 1 || aluop == 3) {
-		r = *rd = rn - operand;
-		CV_FLAGS_SUB;
+		u32 r = *rd = rn - operand;
+		cpu.set_sub_flags(rn, operand, r);
 	}
 
-	NZ_FLAGS_RD;
-
-	WRITE_CPU_FLAGS;
 	cpu.sfetch();
 }
 
 template <u32 aluop>
 void thumb_addsubcmpmov(u16 op)
 {
-	GET_CPU_FLAGS;
-
 	u32 *rd = cpu.get_reg(op >> 8 & BITMASK(3));
 	u32 operand = op & BITMASK(8);
 
 	u32 rn = *rd;
 
-	u32 r;
 	if constexpr (aluop == 0) {
-		r = *rd = operand;
+		u32 r = *rd = operand;
+		cpu.set_logic_flags(r, cpu.get_carry());
 	} else if constexpr (aluop == 1) {
-		r = rn - operand;
-		CV_FLAGS_SUB;
+		u32 r = rn - operand;
+		cpu.set_sub_flags(rn, operand, r);
 	} else if constexpr (aluop == 2) {
-		u64 result = (u64)rn + operand;
-		r = *rd = result;
-		CV_FLAGS_ADD;
+		u32 r = *rd = rn + operand;
+		cpu.set_add_flags(rn, operand, r);
 	} else if constexpr (aluop == 3) {
-		r = *rd = rn - operand;
-		CV_FLAGS_SUB;
+		u32 r = *rd = rn - operand;
+		cpu.set_sub_flags(rn, operand, r);
 	}
 
-	NZ_FLAGS_RD;
-
-	WRITE_CPU_FLAGS;
 	cpu.sfetch();
 }
 
@@ -171,12 +157,11 @@ void thumb_alu(u16 op)
 	} else if constexpr (aluop == 5) {
 		u64 result = (u64)rn + operand + C;
 		r = *rd = result;
-		CV_FLAGS_ADD;
+		cpu.set_flags(r, result > 0xFFFF'FFFF, (rn ^ r) & (operand ^ r) & 0x8000'0000);
 	} else if constexpr (aluop == 6) {
 		s64 result = (s64)rn - operand - (!C);
 		r = *rd = result;
-		C = !(result < 0);
-		V = (rn ^ operand) & (rn ^ r) & 0x8000'0000;
+		cpu.set_flags(r, !(result < 0), (rn ^ operand) & (rn ^ r) & 0x8000'0000);
 	} else if constexpr (aluop == 7) {
 		r = *rd = ror(rn, operand & 0xFF, C);
 	} else if constexpr (aluop == 8) {
@@ -184,14 +169,13 @@ void thumb_alu(u16 op)
 	} else if constexpr (aluop == 9) {
 		rn = 0;
 		r = *rd = rn - operand;
-		CV_FLAGS_SUB;
+		cpu.set_sub_flags(rn, operand, r);
 	} else if constexpr (aluop == 0xA) {
 		r = rn - operand;
-		CV_FLAGS_SUB;
+		cpu.set_sub_flags(rn, operand, r);
 	} else if constexpr (aluop == 0xB) {
-		u64 result = (u64)rn + operand;
-		r = result;
-		CV_FLAGS_ADD;
+		r = rn + operand;
+		cpu.set_add_flags(rn, operand, r);
 	} else if constexpr (aluop == 0xC) {
 		r = *rd = rn | operand;
 	} else if constexpr (aluop == 0xD) {
@@ -204,9 +188,9 @@ void thumb_alu(u16 op)
 		r = *rd = ~operand;
 	}
 
-	NZ_FLAGS_RD;
-
-	WRITE_CPU_FLAGS;
+	if constexpr (aluop != 5 && aluop != 6 && aluop != 9 && aluop != 0xA && aluop != 0xB) {
+		cpu.set_logic_flags(r, C);
+	}
 
 	if constexpr (aluop == 2 || aluop == 3 || aluop == 4 || aluop == 7) {
 		cpu.icycle();
@@ -242,14 +226,9 @@ void thumb_special_data(u16 op)
 			pc_written = true;
 		}
 	} else if constexpr (aluop == 1) {
-		GET_CPU_FLAGS;
-
 		u32 rn = *rd;
 		u32 r = rn - operand;
-		NZ_FLAGS_RD;
-		CV_FLAGS_SUB;
-
-		WRITE_CPU_FLAGS;
+		cpu.set_sub_flags(rn, operand, r);
 	} else if constexpr (aluop == 2) {
 		*rd = operand;
 		if (rdi == 15) {
@@ -269,7 +248,7 @@ void thumb_load_pool(u16 op)
 	u32 *rd = cpu.get_reg(op >> 8 & BITMASK(3));
 	u32 nn = op & BITMASK(8);
 
-	*rd = cpu.nread32_noalign(cpu.pc + nn * 4);
+	*rd = cpu.nread32_noalign(cpu.r[15] + nn * 4);
 	cpu.icycle();
 	if (!prefetch_enabled) {
 		cpu.nfetch();
@@ -429,7 +408,7 @@ void thumb_addpcsp(u16 op)
 	u32 *rd = cpu.get_reg(op >> 8 & BITMASK(3));
 
 	if constexpr (code == 0) {
-		*rd = (cpu.pc & 0xFFFF'FFFC) + (imm << 2);
+		*rd = (cpu.r[15] & 0xFFFF'FFFC) + (imm << 2);
 	} else if constexpr (code == 1) {
 		*rd = *cpu.get_sp() + (imm << 2);
 	}
@@ -559,7 +538,10 @@ void thumb_multiple(u16 op)
 
 void thumb_swi(u16 op)
 {
-	(void)op;
+	if (hle_bios && bios_call(op & BITMASK(8))) {
+		cpu.sfetch();
+		return;
+	}
 
 	cpu.exception_prologue(SUPERVISOR, 0x13);
 	WRITE_PC(VECTOR_SWI);
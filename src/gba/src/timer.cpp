@@ -3,6 +3,7 @@
 #include <gba/scheduler.h>
 
 #include <iostream>
+#include <algorithm>
 
 Timer timer;
 
@@ -15,9 +16,39 @@ static const int timer_freq[] = {
 
 void Timer::step()
 {
-	simulate_elapsed(elapsed - last_timer_update);
+	PROFILE_SCOPE(PROFILE_TIMER);
 
-	last_timer_update = 0;
+	u64 now = current_time();
+
+	if (now >= next_overflow) {
+		update();
+	} else if (next_overflow != TIMER_NEVER) {
+		schedule_after(next_overflow - now);
+	}
+}
+
+/* bring the counters up to now and work out when the next overflow is due */
+void Timer::update()
+{
+	u64 now = current_time();
+
+	simulate_elapsed(now - last_update);
+	last_update = now;
+
+	next_overflow = TIMER_NEVER;
+	for (int i = 0; i < NUM_TIMERS; i++) {
+		u8 tmcnt = TMCNT_H(i);
+		if (!(tmcnt & TIMER_ENABLED) || (tmcnt & TIMER_COUNTUP)) {
+			continue;
+		}
+
+		u32 freq = timer_freq[tmcnt & TIMER_PRESCALE];
+		next_overflow = std::min(next_overflow, now + (0x10000 - values[i]) * freq - tcycles[i]);
+	}
+
+	if (next_overflow != TIMER_NEVER) {
+		schedule_after(next_overflow - now);
+	}
 }
 
 void Timer::simulate_elapsed(u64 dt)
@@ -35,14 +66,23 @@ void Timer::simulate_elapsed(u64 dt)
 		tcycles[i] += dt;
 		u32 freq = timer_freq[tmcnt & TIMER_PRESCALE];
 
-		while (tcycles[i] >= freq) {
-			tcycles[i] -= freq;
+		advance(i, tcycles[i] / freq);
+		tcycles[i] %= freq;
+	}
+}
 
-			do_timer_increment(i);
-		}
+/* count timer i up by ticks, stepping through each overflow on the way */
+void Timer::advance(int i, u32 ticks)
+{
+	while (ticks >= 0x10000 - values[i]) {
+		ticks -= 0x10000 - values[i];
+		values[i] = 0;
 
-		schedule_after((0x10000 - values[i]) * freq - tcycles[i]);
+		/* timer i overflows here */
+		on_timer_overflow(i);
 	}
+
+	values[i] += ticks;
 }
 
 void Timer::do_timer_increment(int i)
@@ -84,8 +124,7 @@ u8 Timer::on_read(addr_t addr)
 {
 	int i = (addr - IO_TM0CNT_L) / 4;
 
-	simulate_elapsed(cpu_cycles - last_timer_update);
-	last_timer_update = cpu_cycles;
+	update();
 
 	return values[i] >> (addr % 2 * 8) & BITMASK(8);
 }
@@ -94,8 +133,10 @@ void Timer::on_write(addr_t addr, u8 old_value, u8 new_value)
 {
 	int i = (addr - IO_TM0CNT_L) / 4;
 
-	simulate_elapsed(cpu_cycles - last_timer_update);
-	last_timer_update = cpu_cycles;
+	update();
+
+	/* the settings change after this, so the next step works it out again */
+	next_overflow = 0;
 
 	if (!(old_value & TIMER_ENABLED) && (new_value & TIMER_ENABLED)) {
 		values[i] = readarr<u16>(io_data, IO_TM0CNT_L - IO_START + i*4);
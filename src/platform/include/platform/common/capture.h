@@ -0,0 +1,70 @@
+#ifndef GBAFLARE_CAPTURE_H
+#define GBAFLARE_CAPTURE_H
+
+#include <common/types.h>
+#include <platform/common/platform.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#define CAPTURE_QUEUE_SIZE 32
+#define CAPTURE_FILE_BUFFER (1 << 20)
+
+struct CaptureFrame {
+	std::unique_ptr<u32[]> pixels;
+	int format;
+	bool has_video;
+	s16 samples[AUDIOBUFFER_SIZE];
+	int num_samples;
+};
+
+/*
+ * Streams emulator output to disk: video as Y4M (YUV 4:2:0) and audio as a
+ * 16-bit stereo WAV. The emulator thread only copies each frame into a
+ * bounded queue; a writer thread converts and writes it with large buffered
+ * writes. The emulator waits only if the writer falls a whole queue behind.
+ * Frames are LCD sized times scale, for frames that went through a Filter.
+ */
+struct Capture {
+	~Capture();
+
+	bool start(const std::string &video_filename, const std::string &audio_filename, int scale = 1);
+	void push(const u32 *pixels, int format, const s16 *samples, int num_samples);
+	void stop();
+	bool active();
+
+	private:
+	FILE *video_file{};
+	FILE *audio_file{};
+	std::unique_ptr<char[]> video_buffer;
+	std::unique_ptr<char[]> audio_buffer;
+	int width{};
+	int height{};
+	u32 audio_bytes{};
+	u64 frames{};
+
+	std::unique_ptr<CaptureFrame[]> queue;
+	std::size_t head{};
+	std::size_t tail{};
+	bool stopping{};
+	std::mutex lock;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::thread writer;
+
+	std::unique_ptr<u8[]> yuv;
+	bool have_yuv{};
+
+	void write_frame(CaptureFrame &f);
+	void run();
+};
+
+extern Capture capture;
+
+void rgb_to_yuv420(const u32 *pixels, int width, int height, u8 *y, u8 *u, u8 *v);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GBAFLARE_EXCHANGE_H
+#define GBAFLARE_EXCHANGE_H
+
+#include <common/types.h>
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Lock-free single producer, single consumer handoff of whole buffers. The
+ * producer fills back() and publishes it, the consumer takes the most recently
+ * published buffer with acquire() and reads front(). Buffers are exchanged by
+ * index, never copied, and neither side ever waits for the other.
+ */
+template<typename T, std::size_t N> struct TripleBuffer {
+	static constexpr u8 FRESH = 0x4;
+	static constexpr u8 INDEX_MASK = 0x3;
+
+	T buffers[3][N]{};
+	std::atomic<u8> middle = 1;
+	u8 back_index = 0;
+	u8 front_index = 2;
+
+	T *back() { return buffers[back_index]; }
+	T *front() { return buffers[front_index]; }
+
+	void publish()
+	{
+		back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	/* returns false if nothing was published since the last call */
+	bool acquire()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+};
+
+/* single producer, single consumer ring of interleaved stereo samples */
+struct AudioRing {
+	static constexpr std::size_t CAPACITY = 16384;
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0);
+
+	s16 data[CAPACITY]{};
+	std::atomic<std::size_t> head{};
+	std::atomic<std::size_t> tail{};
+
+	std::size_t size();
+	std::size_t push(const s16 *samples, std::size_t n);
+	std::size_t pop(s16 *samples, std::size_t n);
+	void clear();
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef GBAFLARE_FILTER_H
+#define GBAFLARE_FILTER_H
+
+#include <common/types.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#define MAX_FILTER_SCALE 3
+#define MAX_FILTER_THREADS 8
+
+enum filter_types {
+	FILTER_NONE,
+	FILTER_NEAREST_2X,
+	FILTER_NEAREST_3X,
+	FILTER_SCALE2X,
+	FILTER_SCALE3X,
+	FILTER_XBR_2X,
+	NUM_FILTERS
+};
+
+extern const char *filter_names[NUM_FILTERS];
+
+/*
+ * Software upscaling of XRGB8888 frames for hosts without a GPU. The frame is
+ * cut into bands of rows that are filtered in parallel by a small pool of
+ * worker threads, with the calling thread taking the first band.
+ */
+struct Filter {
+	int type = FILTER_NONE;
+
+	Filter(int threads = 1);
+	~Filter();
+
+	void set_type(int type);
+	int scale();
+	void apply(const u32 *src, u32 *dst);
+
+	private:
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable start;
+	std::condition_variable done;
+	u64 generation{};
+	int pending{};
+	bool quit{};
+
+	const u32 *src{};
+	u32 *dst{};
+
+	void run_band(int band);
+	void worker(int band);
+};
+
+#endif
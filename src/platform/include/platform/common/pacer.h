@@ -0,0 +1,36 @@
+#ifndef GBAFLARE_PACER_H
+#define GBAFLARE_PACER_H
+
+#include <common/types.h>
+
+#include <chrono>
+
+/* how long before a deadline the pacer stops sleeping and starts spinning */
+#define PACER_SPIN_US 500
+
+/*
+ * Paces a loop to a fixed rate against absolute deadlines, so oversleeping
+ * one frame shortens the next instead of accumulating drift. The thread
+ * sleeps for most of the interval and only spins for the last PACER_SPIN_US.
+ */
+struct FramePacer {
+	typedef std::chrono::steady_clock clock;
+
+	clock::time_point deadline;
+	clock::duration period{};
+	bool started{};
+
+	/* how late wake-ups were since the last reset_stats, in nanoseconds */
+	u64 frames{};
+	u64 late_frames{};
+	s64 total_error{};
+	s64 max_error{};
+
+	void set_rate(double fps);
+	void restart();
+	void wait();
+	void print_stats();
+	void reset_stats();
+};
+
+#endif
@@ -2,16 +2,21 @@
 #define GBAFLARE_PLATFORM_H
 
 #include <common/types.h>
+#include <platform/common/exchange.h>
 #include <semaphore>
 #include <atomic>
 #include <string>
 #include <mutex>
 
-#define SAMPLE_RATE 65536
-#define CYCLES_PER_SAMPLE (16 * 1024 * 1024 / SAMPLE_RATE)
+#define SAMPLE_RATE 48000
 #define CYCLES_PER_FRAME 280896
-#define SAMPLES_PER_FRAME (CYCLES_PER_FRAME / CYCLES_PER_SAMPLE * 2)
-#define AUDIOBUFFER_SIZE SAMPLES_PER_FRAME * 2
+#define SAMPLES_PER_FRAME (((u64)SAMPLE_RATE * CYCLES_PER_FRAME / (16 * 1024 * 1024) + 1) * 2)
+/* room for one frame of stereo samples at up to 96 kHz */
+#define AUDIOBUFFER_SIZE 4096
+/* queued samples the frontend aims to keep ahead of the audio device, about two frames */
+#define AUDIO_TARGET_FILL (SAMPLES_PER_FRAME * 2)
+/* the largest change to the sample rate rate control may make, in parts per million */
+#define AUDIO_MAX_RATE_ADJUST 5000
 
 enum joypad_buttons {
 	BUTTON_A,
@@ -35,6 +40,8 @@ enum emulator_states {
 };
 
 constexpr double FPS = 59.72750057;
+constexpr int FAST_FORWARD_RENDER_INTERVAL = 4;
+constexpr int MAX_RENDER_INTERVAL = 4;
 extern const char *bios_filenames[];
 extern const std::string prog_name;
 
@@ -42,22 +49,35 @@ std::string get_data_dir();
 std::string get_default_bios_path();
 std::string get_default_bios_path(const std::string &s);
 int find_bios_file(std::string &s);
+int locate_bios_file(std::string &s);
+std::string get_movie_path();
 void copy_bios_file(std::string &s);
 void update_joypad(joypad_buttons button, bool down);
+void publish_frame();
+u32 adjusted_sample_rate();
+void wait_for_audio();
 
 struct EmulatorControl {
 	std::atomic_bool emulator_running{};
 	std::atomic_bool throttle_enabled = true;
 	std::atomic_bool print_fps{};
+	/* set by the frontend while its audio device is playing from shared.audio */
+	std::atomic_bool audio_sync{};
+	std::atomic_bool color_correction{};
 	std::atomic_bool debug{};
 
 	std::atomic_uint16_t joypad_state = 0xFFFF;
+	std::atomic_int run_ahead_frames{};
+	std::atomic_int render_interval = 1;
+	std::atomic_int fast_forward_render_interval = FAST_FORWARD_RENDER_INTERVAL;
 
 	std::atomic_bool request_pause{};
 	std::atomic_bool request_reset{};
 	std::atomic_bool request_close{};
 	std::atomic_bool request_open{};
 	std::atomic_bool request_load_bios{};
+	std::atomic_bool request_record{};
+	std::atomic_bool request_playback{};
 
 	std::atomic_int emulator_state = EMULATION_NOBIOS;
 
@@ -65,18 +85,24 @@ struct EmulatorControl {
 	void on_pause();
 	void toggle_throttle();
 	void toggle_print_fps();
+	void cycle_run_ahead();
+	void cycle_frame_skip();
+	int current_render_interval();
 
 	void process_events();
 	void process_reset();
 	void process_close();
 	void process_load();
+	void stop_movie();
 };
 
 extern EmulatorControl emu_cnt;
 
+/* frames and audio go from the emulator thread to the frontend without locking */
 struct SharedState {
-	u16 framebuffer[FRAMEBUFFER_SIZE];
-	s16 audiobuffer[AUDIOBUFFER_SIZE];
+	TripleBuffer<u32, FRAMEBUFFER_SIZE> frames;
+	AudioRing audio;
+
 	std::string cartridge_filename;
 	std::string bios_filename;
 
@@ -85,7 +111,11 @@ struct SharedState {
 
 extern SharedState shared;
 
-extern u16 framebuffer[FRAMEBUFFER_SIZE];
+/*
+ * The PPU draws into the back buffer of shared.frames in output_format.
+ * 16-bit formats use the first half of each buffer.
+ */
+extern u32 *framebuffer;
 extern s16 audiobuffer[AUDIOBUFFER_SIZE];
 
 #endif
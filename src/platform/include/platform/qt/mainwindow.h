@@ -3,19 +3,47 @@
 
 #include <common/types.h>
 #include <platform/common/platform.h>
+#include <platform/common/filter.h>
 #include <QMainWindow>
 #include <QGraphicsScene>
+#include <QGraphicsItem>
+#include <QImage>
 #include <QThread>
 #include <QBuffer>
 #include <QAudioOutput>
 #include <QString>
 #include <QMutex>
 #include <string>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+/* feeds the audio device from shared.audio in pull mode, playing silence when it runs dry */
+class AudioSource : public QIODevice
+{
+	Q_OBJECT
+	public:
+		AudioSource(QObject *parent = nullptr);
+
+		qint64 readData(char *data, qint64 maxlen) override;
+		qint64 writeData(const char *data, qint64 len) override;
+		qint64 bytesAvailable() const override;
+};
+
+/* the LCD, drawn straight from the frame the emulator thread published */
+class ScreenItem : public QGraphicsItem
+{
+	public:
+		QImage image;
+
+		ScreenItem();
+		void set_frame(u32 *pixels, int scale);
+		QRectF boundingRect() const override;
+		void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+};
+
 class EmulatorThread : public QThread
 {
 	Q_OBJECT
@@ -33,21 +61,24 @@ class MainWindow : public QMainWindow
 
 	public:
 		QGraphicsScene *scene{};
+		ScreenItem *screen{};
+		Filter filter;
+		std::vector<u32> filtered;
 		EmulatorThread *emu_thread{};
-		QIODevice *qbuffer{};
+		AudioSource *audio_source{};
 		QAudioOutput *audio{};
-		bool audio_paused{};
 		int do_scale{};
 		MainWindow(QWidget *parent = nullptr);
 		~MainWindow();
 
-		void render(u16 *pixels);
+		void render(u32 *pixels);
 		void keyPressEvent(QKeyEvent *event);
 		void keyReleaseEvent(QKeyEvent *event);
 		joypad_buttons translate_key(int key);
 		bool eventFilter(QObject *object, QEvent *event);
 		void scale_view();
 		void toggle_fullscreen();
+		void cycle_filter();
 
 	private:
 		Ui::MainWindow *ui;
@@ -55,6 +86,7 @@ class MainWindow : public QMainWindow
 
 	public slots:
 		void onEndOfFrame();
+		void onAudioStateChanged(QAudio::State state);
 		void onToolbarOpenROM();
 		void onToolbarLoadBIOS();
 		void onToolbarSaveBIOS();
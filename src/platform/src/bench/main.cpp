@@ -0,0 +1,481 @@
+#include <platform/common/platform.h>
+#include <gba/emulator.h>
+#include <gba/memory.h>
+#include <gba/movie.h>
+#include <gba/profile.h>
+#include <common/hash.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __unix__
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Replays a corpus of input movies through the core at uncapped speed and
+ * reports per-ROM speed as JSON. The core in this binary is built with
+ * GBAFLARE_PROFILE, and a profiling timer samples which subsystem is running
+ * to give a breakdown of where host time goes. With --startup it also times
+ * loading and closing ROMs, phase by phase.
+ */
+
+namespace fs = std::filesystem;
+
+constexpr int PROFILE_SAMPLE_US = 100;
+
+struct BenchResult {
+	std::string movie;
+	std::string rom;
+	std::size_t frames{};
+	double seconds{};
+	u64 host_ticks{};
+	std::size_t mismatches{};
+	u64 samples[NUM_PROFILE_SECTIONS]{};
+};
+
+enum startup_phases {
+	STARTUP_BIOS,
+	STARTUP_ROM,
+	STARTUP_SAVE,
+	STARTUP_FIRST_FRAME,
+	STARTUP_CLOSE,
+	NUM_STARTUP_PHASES
+};
+
+static const char *startup_phase_names[NUM_STARTUP_PHASES] = {
+	"bios_load",
+	"rom_load",
+	"save_load",
+	"first_frame",
+	"close"
+};
+
+struct StartupResult {
+	std::string rom;
+	double seconds[NUM_STARTUP_PHASES]{};
+};
+
+static volatile u64 profile_samples[NUM_PROFILE_SECTIONS];
+
+#if defined(__x86_64__) || defined(__i386__)
+static const char *tick_unit = "tsc";
+
+static u64 host_ticks()
+{
+	return __rdtsc();
+}
+#else
+static const char *tick_unit = "ns";
+
+static u64 host_ticks()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#ifdef __unix__
+static void on_profile_signal(int)
+{
+	int s = profile_section;
+	if (s >= 0 && s < NUM_PROFILE_SECTIONS) {
+		profile_samples[s] = profile_samples[s] + 1;
+	}
+}
+
+static void start_sampling()
+{
+	struct sigaction sa{};
+	sa.sa_handler = on_profile_signal;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &sa, nullptr);
+
+	struct itimerval t{};
+	t.it_interval.tv_usec = PROFILE_SAMPLE_US;
+	t.it_value.tv_usec = PROFILE_SAMPLE_US;
+	setitimer(ITIMER_PROF, &t, nullptr);
+}
+
+static void stop_sampling()
+{
+	struct itimerval t{};
+	setitimer(ITIMER_PROF, &t, nullptr);
+}
+#else
+static void start_sampling() {}
+static void stop_sampling() {}
+#endif
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: %s-bench [options] MOVIE|DIR...\n"
+		"  --bios FILE     bios file (default: searched like the Qt frontend)\n"
+		"  --hle-bios      service BIOS calls natively, runs without a bios file\n"
+		"  --roms DIR      directory to search for the movies' roms (repeatable)\n"
+		"  --repeat N      replay each movie N times and keep the fastest run\n"
+		"  --startup ROM   time loading, running one frame of and closing ROM (repeatable)\n"
+		"  --output FILE   write the JSON report to FILE instead of stdout\n",
+		prog_name.c_str());
+}
+
+static bool hash_file(const fs::path &p, u64 &h)
+{
+	std::error_code ec;
+	auto size = fs::file_size(p, ec);
+	if (ec || size == 0 || size > CARTRIDGE_SIZE) {
+		return false;
+	}
+
+	std::vector<char> data(size);
+	std::ifstream f(p, std::ios_base::binary);
+	f.read(data.data(), size);
+	if (!f.good()) {
+		return false;
+	}
+
+	h = xxhash64(data.data(), size);
+	return true;
+}
+
+/* looks for the rom by name first, then by hash among the .gba files of each directory */
+static bool find_rom(const std::vector<fs::path> &dirs, std::string &rom)
+{
+	u64 h;
+
+	for (auto &d : dirs) {
+		fs::path p = d / movie.rom_name;
+		if (hash_file(p, h) && h == movie.rom_hash) {
+			rom = p.string();
+			return true;
+		}
+	}
+
+	for (auto &d : dirs) {
+		std::error_code ec;
+		for (auto &e : fs::directory_iterator(d, ec)) {
+			if (e.is_regular_file() && e.path().extension() == ".gba" && hash_file(e.path(), h) && h == movie.rom_hash) {
+				rom = e.path().string();
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static void add_movies(const fs::path &p, std::vector<fs::path> &movies)
+{
+	if (!fs::is_directory(p)) {
+		movies.push_back(p);
+		return;
+	}
+
+	std::vector<fs::path> found;
+	for (auto &e : fs::directory_iterator(p)) {
+		if (e.is_regular_file() && e.path().extension() == ".flaremovie") {
+			found.push_back(e.path());
+		}
+	}
+
+	std::sort(found.begin(), found.end());
+	movies.insert(movies.end(), found.begin(), found.end());
+}
+
+static bool run_movie(const fs::path &path, const std::vector<fs::path> &rom_dirs, int repeat, BenchResult &r)
+{
+	r.movie = path.string();
+
+	if (!movie.load(r.movie)) {
+		return false;
+	}
+
+	std::vector<fs::path> dirs = rom_dirs;
+	dirs.push_back(path.parent_path().empty() ? fs::path(".") : path.parent_path());
+
+	if (!find_rom(dirs, args.cartridge_filename)) {
+		fprintf(stderr, "bench: no rom matching %s for %s\n", movie.rom_name.c_str(), r.movie.c_str());
+		return false;
+	}
+	r.rom = movie.rom_name;
+
+	try {
+		emu.init(args);
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return false;
+	}
+
+	emu.set_render_interval(1);
+	r.frames = movie.frames.size();
+
+	for (int i = 0; i < repeat; i++) {
+		if (!movie.start_playback()) {
+			emu.close();
+			return false;
+		}
+
+		for (auto &x : profile_samples) {
+			x = 0;
+		}
+
+		start_sampling();
+		auto start = std::chrono::steady_clock::now();
+		u64 ticks = host_ticks();
+
+		for (std::size_t j = 0; j < r.frames; j++) {
+			emu.run_frame();
+		}
+
+		ticks = host_ticks() - ticks;
+		std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+		stop_sampling();
+
+		if (i == 0 || sec.count() < r.seconds) {
+			r.seconds = sec.count();
+			r.host_ticks = ticks;
+			for (int k = 0; k < NUM_PROFILE_SECTIONS; k++) {
+				r.samples[k] = profile_samples[k];
+			}
+		}
+
+		r.mismatches = std::max(r.mismatches, movie.mismatches);
+		movie.stop();
+	}
+
+	emu.close();
+	return true;
+}
+
+/* the fastest time of each phase over repeat cold starts of rom */
+static bool run_startup(const std::string &rom, int repeat, StartupResult &r)
+{
+	r.rom = rom;
+	args.cartridge_filename = rom;
+
+	for (int i = 0; i < repeat; i++) {
+		double sec[NUM_STARTUP_PHASES]{};
+		auto t = std::chrono::steady_clock::now();
+
+		auto phase_done = [&](int phase) {
+			auto now = std::chrono::steady_clock::now();
+			sec[phase] = std::chrono::duration<double>(now - t).count();
+			t = now;
+		};
+
+		try {
+			if (!args.bios_filename.empty()) {
+				load_bios_rom(args.bios_filename);
+			}
+			phase_done(STARTUP_BIOS);
+
+			emu.load_rom(args);
+			phase_done(STARTUP_ROM);
+
+			emu.load_save();
+			phase_done(STARTUP_SAVE);
+		} catch (std::exception &e) {
+			fprintf(stderr, "%s\n", e.what());
+			return false;
+		}
+
+		emu.boot(args);
+		emu.set_render_interval(1);
+		emu.run_frame();
+		phase_done(STARTUP_FIRST_FRAME);
+
+		emu.close();
+		phase_done(STARTUP_CLOSE);
+
+		for (int k = 0; k < NUM_STARTUP_PHASES; k++) {
+			if (i == 0 || sec[k] < r.seconds[k]) {
+				r.seconds[k] = sec[k];
+			}
+		}
+	}
+
+	return true;
+}
+
+static std::string json_string(const std::string &s)
+{
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if ((unsigned char)c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+static void write_report(FILE *f, const std::vector<BenchResult> &results, const std::vector<StartupResult> &startup)
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"tick_unit\": \"%s\",\n", tick_unit);
+	fprintf(f, "  \"results\": [");
+
+	for (std::size_t i = 0; i < results.size(); i++) {
+		auto &r = results[i];
+		double emulated_cycles = (double)r.frames * CYCLES_PER_FRAME;
+
+		u64 total = 0;
+		for (auto x : r.samples) {
+			total += x;
+		}
+
+		fprintf(f, "%s\n    {\n", i ? "," : "");
+		fprintf(f, "      \"movie\": %s,\n", json_string(r.movie).c_str());
+		fprintf(f, "      \"rom\": %s,\n", json_string(r.rom).c_str());
+		fprintf(f, "      \"frames\": %zu,\n", r.frames);
+		fprintf(f, "      \"seconds\": %.6f,\n", r.seconds);
+		fprintf(f, "      \"fps\": %.3f,\n", r.frames / r.seconds);
+		fprintf(f, "      \"host_ticks_per_emulated_cycle\": %.4f,\n", r.host_ticks / emulated_cycles);
+		fprintf(f, "      \"mismatches\": %zu,\n", r.mismatches);
+		fprintf(f, "      \"profile\": {");
+		for (int k = 0; k < NUM_PROFILE_SECTIONS; k++) {
+			fprintf(f, "%s\"%s\": %.4f", k ? ", " : "", profile_section_names[k], total ? (double)r.samples[k] / total : 0.0);
+		}
+		fprintf(f, "}\n    }");
+	}
+
+	fprintf(f, "\n  ],\n");
+	fprintf(f, "  \"startup\": [");
+
+	for (std::size_t i = 0; i < startup.size(); i++) {
+		auto &r = startup[i];
+
+		double total = 0;
+		for (auto x : r.seconds) {
+			total += x;
+		}
+
+		fprintf(f, "%s\n    {\n", i ? "," : "");
+		fprintf(f, "      \"rom\": %s,\n", json_string(r.rom).c_str());
+		for (int k = 0; k < NUM_STARTUP_PHASES; k++) {
+			fprintf(f, "      \"%s_seconds\": %.6f,\n", startup_phase_names[k], r.seconds[k]);
+		}
+		fprintf(f, "      \"total_seconds\": %.6f\n    }", total);
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<fs::path> rom_dirs;
+	std::vector<fs::path> movies;
+	std::vector<std::string> startup_roms;
+	std::string output_file;
+	int repeat = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--bios" && has_value) {
+			args.bios_filename = argv[++i];
+		} else if (a == "--hle-bios") {
+			args.hle_bios = true;
+		} else if (a == "--roms" && has_value) {
+			rom_dirs.push_back(argv[++i]);
+		} else if (a == "--repeat" && has_value) {
+			repeat = at_least((int)std::strtol(argv[++i], nullptr, 10), 1);
+		} else if (a == "--startup" && has_value) {
+			startup_roms.push_back(argv[++i]);
+		} else if (a == "--output" && has_value) {
+			output_file = argv[++i];
+		} else if (a.size() > 0 && a[0] != '-') {
+			add_movies(a, movies);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (movies.empty() && startup_roms.empty()) {
+		usage();
+		return 2;
+	}
+
+	if (args.bios_filename.empty() && locate_bios_file(args.bios_filename) && !args.hle_bios) {
+		fprintf(stderr, "could not find a bios file, use --bios\n");
+		return 2;
+	}
+
+	try {
+		if (!args.bios_filename.empty()) {
+			load_bios_rom(args.bios_filename);
+		}
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+
+	args.write_saves = false;
+
+	std::vector<BenchResult> results;
+	bool failed = false;
+
+	for (auto &m : movies) {
+		BenchResult r;
+		if (run_movie(m, rom_dirs, repeat, r)) {
+			fprintf(stderr, "bench: %s: %.1f fps\n", r.rom.c_str(), r.frames / r.seconds);
+			failed |= r.mismatches > 0;
+			results.push_back(r);
+		} else {
+			failed = true;
+		}
+	}
+
+	std::vector<StartupResult> startup;
+
+	for (auto &rom : startup_roms) {
+		StartupResult r;
+		if (run_startup(rom, repeat, r)) {
+			double total = 0;
+			for (auto x : r.seconds) {
+				total += x;
+			}
+			fprintf(stderr, "bench: %s: started in %.3f ms\n", rom.c_str(), total * 1000);
+			startup.push_back(r);
+		} else {
+			failed = true;
+		}
+	}
+
+	FILE *f = stdout;
+	if (output_file.length() > 0) {
+		f = std::fopen(output_file.c_str(), "w");
+		if (!f) {
+			fprintf(stderr, "could not open %s\n", output_file.c_str());
+			return 2;
+		}
+	}
+
+	write_report(f, results, startup);
+
+	if (f != stdout) {
+		std::fclose(f);
+	}
+
+	return failed ? 1 : 0;
+}
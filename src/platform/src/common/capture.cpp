@@ -0,0 +1,330 @@
+#include <platform/common/capture.h>
+#include <gba/ppu.h>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Capture capture;
+
+/* the GBA's refresh rate, 2^24 / 280896 reduced */
+constexpr int FRAME_RATE_NUM = 262144;
+constexpr int FRAME_RATE_DEN = 4389;
+
+/* full-range BT.601 in 8-bit fixed point; pixels are B, G, R, X in memory */
+static inline int luma(int r, int g, int b)
+{
+	return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+static inline int chroma_u(int r, int g, int b)
+{
+	return ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+}
+
+static inline int chroma_v(int r, int g, int b)
+{
+	return ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+}
+
+static inline u8 clamp8(int x)
+{
+	return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+#ifdef __SSE2__
+/* sums the two 16-bit products of each pixel and packs the four results into the low 32 bits */
+static inline __m128i dot4(__m128i lo, __m128i hi, __m128i coef)
+{
+	__m128i a = _mm_madd_epi16(lo, coef);
+	__m128i b = _mm_madd_epi16(hi, coef);
+	a = _mm_add_epi32(a, _mm_srli_epi64(a, 32));
+	b = _mm_add_epi32(b, _mm_srli_epi64(b, 32));
+	a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 2, 0));
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 2, 0));
+	return _mm_unpacklo_epi64(a, b);
+}
+#endif
+
+/*
+ * Converts an XRGB8888 frame with even dimensions to planar YUV 4:2:0, chroma
+ * taken from the average of each 2x2 block.
+ */
+void rgb_to_yuv420(const u32 *pixels, int width, int height, u8 *y, u8 *u, u8 *v)
+{
+	for (int row = 0; row < height; row += 2) {
+		const u32 *p0 = pixels + row * width;
+		const u32 *p1 = p0 + width;
+		u8 *y0 = y + row * width;
+		u8 *y1 = y0 + width;
+		u8 *cu = u + row / 2 * width / 2;
+		u8 *cv = v + row / 2 * width / 2;
+		int x = 0;
+
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(128);
+		const __m128i bias = _mm_set1_epi32(128);
+		const __m128i ycoef = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+		const __m128i ucoef = _mm_setr_epi16(128, -85, -43, 0, 128, -85, -43, 0);
+		const __m128i vcoef = _mm_setr_epi16(-21, -107, 128, 0, -21, -107, 128, 0);
+
+		for (; x + 4 <= width; x += 4) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(p0 + x));
+			__m128i b = _mm_loadu_si128((const __m128i *)(p1 + x));
+
+			__m128i ya = _mm_srai_epi32(_mm_add_epi32(dot4(_mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero), ycoef), round), 8);
+			__m128i yb = _mm_srai_epi32(_mm_add_epi32(dot4(_mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero), ycoef), round), 8);
+			__m128i yab = _mm_packus_epi16(_mm_packs_epi32(ya, yb), zero);
+			u32 la = _mm_cvtsi128_si32(yab);
+			u32 lb = _mm_cvtsi128_si32(_mm_srli_si128(yab, 4));
+			std::memcpy(y0 + x, &la, 4);
+			std::memcpy(y1 + x, &lb, 4);
+
+			/* average vertically, then horizontally into pixels 0 and 2 */
+			__m128i c = _mm_avg_epu8(a, b);
+			c = _mm_avg_epu8(c, _mm_srli_si128(c, 4));
+			c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i c16 = _mm_unpacklo_epi8(c, zero);
+
+			__m128i uu = dot4(c16, zero, ucoef);
+			__m128i vv = dot4(c16, zero, vcoef);
+			uu = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(uu, round), 8), bias);
+			vv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(vv, round), 8), bias);
+			__m128i uv = _mm_packus_epi16(_mm_packs_epi32(uu, vv), zero);
+
+			cu[x / 2] = _mm_extract_epi16(uv, 0) & 0xFF;
+			cu[x / 2 + 1] = _mm_extract_epi16(uv, 0) >> 8;
+			cv[x / 2] = _mm_extract_epi16(uv, 2) & 0xFF;
+			cv[x / 2 + 1] = _mm_extract_epi16(uv, 2) >> 8;
+		}
+#endif
+
+		for (; x < width; x += 2) {
+			int r, g, b;
+			u32 q[2][2] = {{p0[x], p0[x + 1]}, {p1[x], p1[x + 1]}};
+
+			for (int i = 0; i < 2; i++) {
+				for (int j = 0; j < 2; j++) {
+					u32 c = q[i][j];
+					(i ? y1 : y0)[x + j] = luma(c >> 16 & 0xFF, c >> 8 & 0xFF, c & 0xFF);
+				}
+			}
+
+			/* rounded the same way as the vector path: rows first, then columns */
+			auto avg = [](int a, int b) { return (a + b + 1) >> 1; };
+			auto channel = [&](int shift) {
+				int left = avg(q[0][0] >> shift & 0xFF, q[1][0] >> shift & 0xFF);
+				int right = avg(q[0][1] >> shift & 0xFF, q[1][1] >> shift & 0xFF);
+				return avg(left, right);
+			};
+			r = channel(16);
+			g = channel(8);
+			b = channel(0);
+
+			cu[x / 2] = clamp8(chroma_u(r, g, b));
+			cv[x / 2] = clamp8(chroma_v(r, g, b));
+		}
+	}
+}
+
+static void write_wav_header(FILE *f, u32 data_bytes)
+{
+	auto put32 = [&](u32 x) { fwrite(&x, 4, 1, f); };
+	auto put16 = [&](u16 x) { fwrite(&x, 2, 1, f); };
+
+	fwrite("RIFF", 4, 1, f);
+	put32(36 + data_bytes);
+	fwrite("WAVEfmt ", 8, 1, f);
+	put32(16);
+	put16(1);
+	put16(2);
+	put32(SAMPLE_RATE);
+	put32(SAMPLE_RATE * 2 * sizeof(s16));
+	put16(2 * sizeof(s16));
+	put16(16);
+	fwrite("data", 4, 1, f);
+	put32(data_bytes);
+}
+
+Capture::~Capture()
+{
+	stop();
+}
+
+bool Capture::start(const std::string &video_filename, const std::string &audio_filename, int scale)
+{
+	stop();
+
+	width = LCD_WIDTH * scale;
+	height = LCD_HEIGHT * scale;
+
+	if (video_filename.length() > 0) {
+		video_file = std::fopen(video_filename.c_str(), "wb");
+		if (!video_file) {
+			fprintf(stderr, "capture: could not open %s\n", video_filename.c_str());
+			return false;
+		}
+		video_buffer = std::make_unique<char[]>(CAPTURE_FILE_BUFFER);
+		setvbuf(video_file, video_buffer.get(), _IOFBF, CAPTURE_FILE_BUFFER);
+		fprintf(video_file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height, FRAME_RATE_NUM, FRAME_RATE_DEN);
+	}
+
+	if (audio_filename.length() > 0) {
+		audio_file = std::fopen(audio_filename.c_str(), "wb");
+		if (!audio_file) {
+			fprintf(stderr, "capture: could not open %s\n", audio_filename.c_str());
+			stop();
+			return false;
+		}
+		audio_buffer = std::make_unique<char[]>(CAPTURE_FILE_BUFFER);
+		setvbuf(audio_file, audio_buffer.get(), _IOFBF, CAPTURE_FILE_BUFFER);
+		write_wav_header(audio_file, 0);
+	}
+
+	if (!video_file && !audio_file) {
+		return false;
+	}
+
+	queue = std::make_unique<CaptureFrame[]>(CAPTURE_QUEUE_SIZE);
+	if (video_file) {
+		for (int i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+			queue[i].pixels = std::make_unique<u32[]>(width * height);
+		}
+	}
+	yuv = std::make_unique<u8[]>(width * height * 3 / 2);
+	have_yuv = false;
+	head = tail = 0;
+	frames = 0;
+	audio_bytes = 0;
+	stopping = false;
+
+	writer = std::thread(&Capture::run, this);
+	return true;
+}
+
+bool Capture::active()
+{
+	return writer.joinable();
+}
+
+/* pixels is null for a frame that was not rendered, which repeats the last one; otherwise it holds the scaled frame */
+void Capture::push(const u32 *pixels, int format, const s16 *samples, int num_samples)
+{
+	if (!active()) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lk(lock);
+	not_full.wait(lk, [&] { return tail - head < CAPTURE_QUEUE_SIZE; });
+	lk.unlock();
+
+	/* the writer never touches the slot at tail until it is published below */
+	auto &f = queue[tail % CAPTURE_QUEUE_SIZE];
+	f.has_video = pixels != nullptr && video_file;
+	if (f.has_video) {
+		f.format = format;
+		std::memcpy(f.pixels.get(), pixels, width * height * (format == OUTPUT_XRGB8888 ? sizeof(u32) : sizeof(u16)));
+	}
+	f.num_samples = at_most(num_samples, AUDIOBUFFER_SIZE);
+	std::memcpy(f.samples, samples, f.num_samples * sizeof(*samples));
+
+	lk.lock();
+	tail++;
+	lk.unlock();
+	not_empty.notify_one();
+}
+
+void Capture::stop()
+{
+	if (active()) {
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			stopping = true;
+		}
+		not_empty.notify_one();
+		writer.join();
+
+		fprintf(stderr, "capture: wrote %llu frames\n", (unsigned long long)frames);
+	}
+
+	if (video_file) {
+		std::fclose(video_file);
+		video_file = nullptr;
+	}
+
+	if (audio_file) {
+		std::fseek(audio_file, 0, SEEK_SET);
+		write_wav_header(audio_file, audio_bytes);
+		std::fclose(audio_file);
+		audio_file = nullptr;
+	}
+
+	video_buffer.reset();
+	audio_buffer.reset();
+	queue.reset();
+	yuv.reset();
+}
+
+void Capture::write_frame(CaptureFrame &f)
+{
+	if (video_file) {
+		if (f.has_video) {
+			if (f.format != OUTPUT_XRGB8888) {
+				/* expand 16-bit pixels in place, back to front */
+				u16 *p16 = (u16 *)f.pixels.get();
+				for (int i = width * height - 1; i >= 0; i--) {
+					u32 c = p16[i];
+					u32 r, g, b;
+					if (f.format == OUTPUT_RGB565) {
+						r = (c >> 11 & 0x1F) << 3;
+						g = (c >> 5 & 0x3F) << 2;
+						b = (c & 0x1F) << 3;
+					} else {
+						r = (c & 0x1F) << 3;
+						g = (c >> 5 & 0x1F) << 3;
+						b = (c >> 10 & 0x1F) << 3;
+					}
+					f.pixels[i] = (r | r >> 5) << 16 | (g | g >> 6) << 8 | (b | b >> 5);
+				}
+			}
+
+			int y_size = width * height;
+			rgb_to_yuv420(f.pixels.get(), width, height, yuv.get(), yuv.get() + y_size, yuv.get() + y_size * 5 / 4);
+			have_yuv = true;
+		}
+
+		if (have_yuv) {
+			std::fputs("FRAME\n", video_file);
+			std::fwrite(yuv.get(), 1, width * height * 3 / 2, video_file);
+		}
+	}
+
+	if (audio_file) {
+		std::fwrite(f.samples, sizeof(*f.samples), f.num_samples, audio_file);
+		audio_bytes += f.num_samples * sizeof(*f.samples);
+	}
+
+	frames++;
+}
+
+void Capture::run()
+{
+	for (;;) {
+		std::unique_lock<std::mutex> lk(lock);
+		not_empty.wait(lk, [&] { return stopping || head != tail; });
+		if (head == tail) {
+			return;
+		}
+		lk.unlock();
+
+		write_frame(queue[head % CAPTURE_QUEUE_SIZE]);
+
+		lk.lock();
+		head++;
+		lk.unlock();
+		not_full.notify_one();
+	}
+}
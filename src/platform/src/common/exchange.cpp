@@ -0,0 +1,49 @@
+#include <platform/common/exchange.h>
+
+#include <algorithm>
+#include <cstring>
+
+std::size_t AudioRing::size()
+{
+	return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+/* producer side: writes as many samples as fit and returns how many */
+std::size_t AudioRing::push(const s16 *samples, std::size_t n)
+{
+	std::size_t t = tail.load(std::memory_order_relaxed);
+	std::size_t h = head.load(std::memory_order_acquire);
+
+	n = std::min(n, CAPACITY - (t - h));
+
+	std::size_t offset = t % CAPACITY;
+	std::size_t first = std::min(n, CAPACITY - offset);
+	std::memcpy(data + offset, samples, first * sizeof(*samples));
+	std::memcpy(data, samples + first, (n - first) * sizeof(*samples));
+
+	tail.store(t + n, std::memory_order_release);
+	return n;
+}
+
+/* consumer side: reads up to n samples and returns how many */
+std::size_t AudioRing::pop(s16 *samples, std::size_t n)
+{
+	std::size_t h = head.load(std::memory_order_relaxed);
+	std::size_t t = tail.load(std::memory_order_acquire);
+
+	n = std::min(n, t - h);
+
+	std::size_t offset = h % CAPACITY;
+	std::size_t first = std::min(n, CAPACITY - offset);
+	std::memcpy(samples, data + offset, first * sizeof(*samples));
+	std::memcpy(samples + first, data, (n - first) * sizeof(*samples));
+
+	head.store(h + n, std::memory_order_release);
+	return n;
+}
+
+/* consumer side: drops everything queued */
+void AudioRing::clear()
+{
+	head.store(tail.load(std::memory_order_acquire), std::memory_order_release);
+}
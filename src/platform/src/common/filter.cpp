@@ -0,0 +1,414 @@
+#include <platform/common/filter.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const char *filter_names[NUM_FILTERS] = {
+	"none",
+	"nearest 2x",
+	"nearest 3x",
+	"scale2x",
+	"scale3x",
+	"xbr 2x"
+};
+
+static const int filter_scales[NUM_FILTERS] = {1, 2, 3, 2, 3, 2};
+
+constexpr int W = LCD_WIDTH;
+constexpr int H = LCD_HEIGHT;
+
+/* the source rows a band reads, with PAD pixels of clamped border on every side */
+constexpr int PAD = 2;
+constexpr int PW = W + 2 * PAD;
+
+/* yuv distance below which xBR treats two colors as the same */
+constexpr int XBR_EQ_THRESHOLD = 155;
+
+static void pad_rows(const u32 *src, int y0, int y1, u32 *out)
+{
+	for (int y = y0 - PAD; y < y1 + PAD; y++) {
+		const u32 *row = src + std::clamp(y, 0, H - 1) * W;
+		u32 *p = out + (y - y0 + PAD) * PW;
+
+		for (int x = 0; x < PAD; x++) {
+			p[x] = row[0];
+			p[PAD + W + x] = row[W - 1];
+		}
+		std::memcpy(p + PAD, row, W * sizeof(*row));
+	}
+}
+
+static void nearest_rows(const u32 *src, u32 *dst, int y0, int y1, int s)
+{
+	for (int y = y0; y < y1; y++) {
+		const u32 *in = src + y * W;
+		u32 *out = dst + y * s * W * s;
+
+#ifdef __SSE2__
+		if (s == 2) {
+			for (int x = 0; x < W; x += 4) {
+				__m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+				_mm_storeu_si128((__m128i *)(out + 2 * x), _mm_unpacklo_epi32(v, v));
+				_mm_storeu_si128((__m128i *)(out + 2 * x + 4), _mm_unpackhi_epi32(v, v));
+			}
+		} else
+#endif
+		{
+			for (int x = 0; x < W; x++) {
+				for (int k = 0; k < s; k++) {
+					out[x * s + k] = in[x];
+				}
+			}
+		}
+
+		for (int k = 1; k < s; k++) {
+			std::memcpy(out + k * W * s, out, W * s * sizeof(*out));
+		}
+	}
+}
+
+/*
+ * Scale2x (AdvMAME2x). Around E, with B above, D left, F right and H below,
+ * each quarter of E takes the color of the two neighbors it touches when
+ * they match and the opposite pair does not.
+ */
+static void scale2x_rows(const u32 *pad, u32 *dst, int y0, int y1)
+{
+	for (int y = y0; y < y1; y++) {
+		const u32 *e = pad + (y - y0 + PAD) * PW + PAD;
+		const u32 *b = e - PW;
+		const u32 *h = e + PW;
+		u32 *out0 = dst + 2 * y * 2 * W;
+		u32 *out1 = out0 + 2 * W;
+		int x = 0;
+
+#ifdef __SSE2__
+		for (; x < W; x += 4) {
+			__m128i B = _mm_loadu_si128((const __m128i *)(b + x));
+			__m128i D = _mm_loadu_si128((const __m128i *)(e + x - 1));
+			__m128i E = _mm_loadu_si128((const __m128i *)(e + x));
+			__m128i F = _mm_loadu_si128((const __m128i *)(e + x + 1));
+			__m128i Hv = _mm_loadu_si128((const __m128i *)(h + x));
+
+			__m128i db = _mm_cmpeq_epi32(D, B);
+			__m128i bf = _mm_cmpeq_epi32(B, F);
+			__m128i dh = _mm_cmpeq_epi32(D, Hv);
+			__m128i hf = _mm_cmpeq_epi32(Hv, F);
+
+			__m128i c0 = _mm_andnot_si128(_mm_or_si128(bf, dh), db);
+			__m128i c1 = _mm_andnot_si128(_mm_or_si128(db, hf), bf);
+			__m128i c2 = _mm_andnot_si128(_mm_or_si128(db, hf), dh);
+			__m128i c3 = _mm_andnot_si128(_mm_or_si128(dh, bf), hf);
+
+			__m128i e0 = _mm_or_si128(_mm_and_si128(c0, D), _mm_andnot_si128(c0, E));
+			__m128i e1 = _mm_or_si128(_mm_and_si128(c1, F), _mm_andnot_si128(c1, E));
+			__m128i e2 = _mm_or_si128(_mm_and_si128(c2, D), _mm_andnot_si128(c2, E));
+			__m128i e3 = _mm_or_si128(_mm_and_si128(c3, F), _mm_andnot_si128(c3, E));
+
+			_mm_storeu_si128((__m128i *)(out0 + 2 * x), _mm_unpacklo_epi32(e0, e1));
+			_mm_storeu_si128((__m128i *)(out0 + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+			_mm_storeu_si128((__m128i *)(out1 + 2 * x), _mm_unpacklo_epi32(e2, e3));
+			_mm_storeu_si128((__m128i *)(out1 + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+		}
+#endif
+
+		for (; x < W; x++) {
+			u32 B = b[x], D = e[x - 1], E = e[x], F = e[x + 1], Hv = h[x];
+
+			out0[2 * x] = D == B && B != F && D != Hv ? D : E;
+			out0[2 * x + 1] = B == F && B != D && F != Hv ? F : E;
+			out1[2 * x] = D == Hv && D != B && Hv != F ? D : E;
+			out1[2 * x + 1] = Hv == F && D != Hv && B != F ? F : E;
+		}
+	}
+}
+
+/* Scale3x (AdvMAME3x), the same rules extended to the corners A, C, G and I */
+static void scale3x_rows(const u32 *pad, u32 *dst, int y0, int y1)
+{
+	for (int y = y0; y < y1; y++) {
+		const u32 *e = pad + (y - y0 + PAD) * PW + PAD;
+		const u32 *b = e - PW;
+		const u32 *h = e + PW;
+		u32 *out0 = dst + 3 * y * 3 * W;
+		u32 *out1 = out0 + 3 * W;
+		u32 *out2 = out1 + 3 * W;
+
+		for (int x = 0; x < W; x++) {
+			u32 A = b[x - 1], B = b[x], C = b[x + 1];
+			u32 D = e[x - 1], E = e[x], F = e[x + 1];
+			u32 G = h[x - 1], Hv = h[x], I = h[x + 1];
+
+			bool db = D == B && B != F && D != Hv;
+			bool bf = B == F && B != D && F != Hv;
+			bool dh = D == Hv && D != B && Hv != F;
+			bool hf = Hv == F && D != Hv && B != F;
+
+			out0[3 * x] = db ? D : E;
+			out0[3 * x + 1] = (db && E != C) || (bf && E != A) ? B : E;
+			out0[3 * x + 2] = bf ? F : E;
+			out1[3 * x] = (db && E != G) || (dh && E != A) ? D : E;
+			out1[3 * x + 1] = E;
+			out1[3 * x + 2] = (bf && E != I) || (hf && E != C) ? F : E;
+			out2[3 * x] = dh ? D : E;
+			out2[3 * x + 1] = (dh && E != I) || (hf && E != G) ? Hv : E;
+			out2[3 * x + 2] = hf ? F : E;
+		}
+	}
+}
+
+/* Y, U + 128 and V + 128 packed into the low three bytes */
+static u32 rgb_to_yuv(u32 c)
+{
+	int r = c >> 16 & 0xFF;
+	int g = c >> 8 & 0xFF;
+	int b = c & 0xFF;
+
+	int y = (299 * r + 587 * g + 114 * b) / 1000;
+	int u = (-169 * r - 331 * g + 500 * b) / 1000 + 128;
+	int v = (500 * r - 419 * g - 81 * b) / 1000 + 128;
+
+	return y << 16 | std::clamp(u, 0, 255) << 8 | std::clamp(v, 0, 255);
+}
+
+static int yuv_distance(u32 a, u32 b)
+{
+	int dy = std::abs((int)(a >> 16 & 0xFF) - (int)(b >> 16 & 0xFF));
+	int du = std::abs((int)(a >> 8 & 0xFF) - (int)(b >> 8 & 0xFF));
+	int dv = std::abs((int)(a & 0xFF) - (int)(b & 0xFF));
+
+	return 48 * dy + 7 * du + 6 * dv;
+}
+
+/* moves dst a/256 of the way towards src */
+static u32 blend(u32 dst, u32 src, int a)
+{
+	u32 out = 0;
+	for (int shift = 0; shift < 24; shift += 8) {
+		int d = dst >> shift & 0xFF;
+		int s = src >> shift & 0xFF;
+		out |= (u32)(d + ((s - d) * a >> 8)) << shift;
+	}
+	return out | 0xFF00'0000;
+}
+
+/*
+ * The 5x5 neighborhood of E used by xBR:
+ *
+ *        A1 B1 C1
+ *     A0 PA PB PC C4
+ *     D0 PD PE PF F4
+ *     G0 PG PH PI I4
+ *        G5 H5 I5
+ */
+enum xbr_neighbors {
+	PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1,
+	NUM_XBR_NEIGHBORS
+};
+
+static const int xbr_dx[NUM_XBR_NEIGHBORS] = {0, 1, 0, 1, -1, 1, -1, 0, -1, -1, 2, -2, -2, 1, 0, 2, 2, 0, 1, -2, -1};
+static const int xbr_dy[NUM_XBR_NEIGHBORS] = {0, 1, 1, 0, 1, -1, 0, -1, -1, 2, -1, 1, 0, -2, -2, 0, 1, 2, 2, -1, -2};
+
+/* the neighborhood seen from each of the four corners, and which outputs they write */
+static const int xbr_rotations[4][NUM_XBR_NEIGHBORS] = {
+	{PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1},
+	{PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0},
+	{PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5},
+	{PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4}
+};
+static const int xbr_outputs[4][3] = {{1, 2, 3}, {0, 3, 1}, {2, 1, 0}, {3, 0, 2}};
+
+static int xbr_offsets[4][NUM_XBR_NEIGHBORS];
+
+static void init_xbr_offsets()
+{
+	for (int r = 0; r < 4; r++) {
+		for (int n = 0; n < NUM_XBR_NEIGHBORS; n++) {
+			int k = xbr_rotations[r][n];
+			xbr_offsets[r][n] = xbr_dy[k] * PW + xbr_dx[k];
+		}
+	}
+}
+
+/* 2xBR level 1: blends the corner of E facing an edge towards the color across it */
+static void xbr_corner(const u32 *rgb, const u32 *yuv, const int *o, u32 *out, const int *n)
+{
+	auto c = [&](int k) { return rgb[o[k]]; };
+	auto df = [&](int a, int b) { return yuv_distance(yuv[o[a]], yuv[o[b]]); };
+	auto eq = [&](int a, int b) { return df(a, b) < XBR_EQ_THRESHOLD; };
+
+	if (c(PE) == c(PH) || c(PE) == c(PF)) {
+		return;
+	}
+
+	int e = df(PE, PC) + df(PE, PG) + df(PI, H5) + df(PI, F4) + (df(PH, PF) << 2);
+	int i = df(PH, PD) + df(PH, I5) + df(PF, I4) + df(PF, PB) + (df(PE, PI) << 2);
+	u32 px = df(PE, PF) <= df(PE, PH) ? c(PF) : c(PH);
+
+	if (e < i && ((!eq(PF, PB) && !eq(PH, PD)) || (eq(PE, PI) && !eq(PF, I4) && !eq(PH, I5)) || eq(PE, PG) || eq(PE, PC))) {
+		int ke = df(PF, PG);
+		int ki = df(PH, PC);
+		bool left = (ke << 1) <= ki && c(PE) != c(PG) && c(PD) != c(PG);
+		bool up = ke >= (ki << 1) && c(PE) != c(PC) && c(PB) != c(PC);
+
+		if (left && up) {
+			out[n[2]] = blend(out[n[2]], px, 224);
+			out[n[1]] = blend(out[n[1]], px, 64);
+			out[n[0]] = out[n[1]];
+		} else if (left) {
+			out[n[2]] = blend(out[n[2]], px, 192);
+			out[n[1]] = blend(out[n[1]], px, 64);
+		} else if (up) {
+			out[n[2]] = blend(out[n[2]], px, 192);
+			out[n[0]] = blend(out[n[0]], px, 64);
+		} else {
+			out[n[2]] = blend(out[n[2]], px, 128);
+		}
+	} else if (e <= i) {
+		out[n[2]] = blend(out[n[2]], px, 64);
+	}
+}
+
+static void xbr2x_rows(const u32 *pad, u32 *yuv, u32 *dst, int y0, int y1)
+{
+	int rows = y1 - y0 + 2 * PAD;
+	for (int i = 0; i < rows * PW; i++) {
+		yuv[i] = rgb_to_yuv(pad[i]);
+	}
+
+	for (int y = y0; y < y1; y++) {
+		int base = (y - y0 + PAD) * PW + PAD;
+		u32 *out0 = dst + 2 * y * 2 * W;
+		u32 *out1 = out0 + 2 * W;
+
+		for (int x = 0; x < W; x++) {
+			const u32 *rgb = pad + base + x;
+			const u32 *yv = yuv + base + x;
+			u32 out[4] = {*rgb, *rgb, *rgb, *rgb};
+
+			for (int r = 0; r < 4; r++) {
+				xbr_corner(rgb, yv, xbr_offsets[r], out, xbr_outputs[r]);
+			}
+
+			out0[2 * x] = out[0];
+			out0[2 * x + 1] = out[1];
+			out1[2 * x] = out[2];
+			out1[2 * x + 1] = out[3];
+		}
+	}
+}
+
+Filter::Filter(int threads)
+{
+	init_xbr_offsets();
+
+	int n = std::clamp(threads, 1, MAX_FILTER_THREADS);
+	for (int i = 1; i < n; i++) {
+		workers.emplace_back(&Filter::worker, this, i);
+	}
+}
+
+Filter::~Filter()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		quit = true;
+	}
+	start.notify_all();
+
+	for (auto &t : workers) {
+		t.join();
+	}
+}
+
+void Filter::set_type(int t)
+{
+	type = std::clamp(t, 0, NUM_FILTERS - 1);
+}
+
+int Filter::scale()
+{
+	return filter_scales[type];
+}
+
+/* dst must hold LCD_WIDTH * LCD_HEIGHT * scale() * scale() pixels */
+void Filter::apply(const u32 *s, u32 *d)
+{
+	src = s;
+	dst = d;
+
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		pending = workers.size();
+		generation++;
+	}
+	start.notify_all();
+
+	run_band(0);
+
+	std::unique_lock<std::mutex> lk(lock);
+	done.wait(lk, [&] { return pending == 0; });
+}
+
+void Filter::run_band(int band)
+{
+	static thread_local std::vector<u32> pad;
+	static thread_local std::vector<u32> yuv;
+
+	int n = workers.size() + 1;
+	int y0 = band * H / n;
+	int y1 = (band + 1) * H / n;
+
+	if (type == FILTER_NONE) {
+		std::memcpy(dst + y0 * W, src + y0 * W, (y1 - y0) * W * sizeof(*src));
+		return;
+	}
+
+	if (type == FILTER_NEAREST_2X || type == FILTER_NEAREST_3X) {
+		nearest_rows(src, dst, y0, y1, scale());
+		return;
+	}
+
+	pad.resize((y1 - y0 + 2 * PAD) * PW);
+	pad_rows(src, y0, y1, pad.data());
+
+	switch (type) {
+		case FILTER_SCALE2X:
+			scale2x_rows(pad.data(), dst, y0, y1);
+			break;
+		case FILTER_SCALE3X:
+			scale3x_rows(pad.data(), dst, y0, y1);
+			break;
+		case FILTER_XBR_2X:
+			yuv.resize(pad.size());
+			xbr2x_rows(pad.data(), yuv.data(), dst, y0, y1);
+			break;
+	}
+}
+
+void Filter::worker(int band)
+{
+	u64 seen = 0;
+
+	for (;;) {
+		std::unique_lock<std::mutex> lk(lock);
+		start.wait(lk, [&] { return quit || generation != seen; });
+		if (quit) {
+			return;
+		}
+		seen = generation;
+		lk.unlock();
+
+		run_band(band);
+
+		lk.lock();
+		if (--pending == 0) {
+			done.notify_one();
+		}
+	}
+}
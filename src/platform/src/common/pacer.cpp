@@ -0,0 +1,91 @@
+#include <platform/common/pacer.h>
+
+#include <thread>
+#include <cstdio>
+#include <algorithm>
+
+#ifdef __linux__
+#include <time.h>
+#include <cerrno>
+#endif
+
+void FramePacer::set_rate(double fps)
+{
+	period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps));
+	restart();
+}
+
+/* the next wait() ends one period from now */
+void FramePacer::restart()
+{
+	started = false;
+}
+
+static void sleep_until(FramePacer::clock::time_point t)
+{
+#ifdef __linux__
+	/* steady_clock is CLOCK_MONOTONIC here, so its epoch can be handed to the kernel as is */
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+	struct timespec ts;
+	ts.tv_sec = ns / 1'000'000'000;
+	ts.tv_nsec = ns % 1'000'000'000;
+	int err;
+	while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr)) == EINTR)
+		;
+	/* the error comes back as the return value, errno is left alone */
+	if (err != 0) {
+		std::this_thread::sleep_until(t);
+	}
+#else
+	std::this_thread::sleep_until(t);
+#endif
+}
+
+void FramePacer::wait()
+{
+	auto now = clock::now();
+
+	if (!started) {
+		started = true;
+		deadline = now + period;
+	} else {
+		deadline += period;
+
+		/* more than a frame behind: start over rather than rush to catch up */
+		if (now > deadline + period) {
+			deadline = now + period;
+		}
+	}
+
+	auto spin_start = deadline - std::chrono::microseconds(PACER_SPIN_US);
+	if (now < spin_start) {
+		sleep_until(spin_start);
+	}
+
+	while ((now = clock::now()) < deadline)
+		;
+
+	s64 error = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count();
+	frames++;
+	total_error += error;
+	max_error = std::max(max_error, error);
+	if (error > PACER_SPIN_US * 1000) {
+		late_frames++;
+	}
+}
+
+void FramePacer::print_stats()
+{
+	if (frames > 0) {
+		fprintf(stderr, "pacing: %llu frames, mean error %.3f ms, max %.3f ms, %llu late\n",
+			(unsigned long long)frames, total_error / 1e6 / frames, max_error / 1e6, (unsigned long long)late_frames);
+	}
+}
+
+void FramePacer::reset_stats()
+{
+	frames = 0;
+	late_frames = 0;
+	total_error = 0;
+	max_error = 0;
+}
@@ -1,6 +1,7 @@
 #include <platform/common/platform.h>
 #include <gba/memory.h>
 #include <gba/emulator.h>
+#include <gba/movie.h>
 
 #include <string>
 #include <stdexcept>
@@ -10,6 +11,8 @@
 #include <fstream>
 #include <cstdlib>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
 
 const char *bios_filenames[] = {
 	"gba_bios.bin",
@@ -21,7 +24,7 @@ const std::string prog_name = "gbaflare";
 EmulatorControl emu_cnt;
 SharedState shared;
 
-u16 framebuffer[FRAMEBUFFER_SIZE];
+u32 *framebuffer = shared.frames.back();
 s16 audiobuffer[AUDIOBUFFER_SIZE];
 
 void EmulatorControl::process_events()
@@ -57,6 +60,7 @@ void EmulatorControl::process_events()
 		request_close = false;
 
 		if (emulator_state == EMULATION_PAUSED || emulator_state == EMULATION_RUNNING) {
+			stop_movie();
 			emu.close();
 			on_close();
 			emulator_state = EMULATION_STOPPED;
@@ -67,12 +71,37 @@ void EmulatorControl::process_events()
 		request_reset = false;
 
 		if (emulator_state == EMULATION_PAUSED || emulator_state == EMULATION_RUNNING) {
+			stop_movie();
 			emu.reset();
 
 			emulator_state = EMULATION_RUNNING;
 		}
 	}
 
+	if (request_record) {
+		request_record = false;
+
+		if (emulator_state == EMULATION_PAUSED || emulator_state == EMULATION_RUNNING) {
+			if (movie.mode == MOVIE_RECORDING) {
+				stop_movie();
+			} else {
+				stop_movie();
+				movie.start_recording();
+			}
+		}
+	}
+
+	if (request_playback) {
+		request_playback = false;
+
+		if (emulator_state == EMULATION_PAUSED || emulator_state == EMULATION_RUNNING) {
+			stop_movie();
+			if (movie.load(get_movie_path())) {
+				movie.start_playback();
+			}
+		}
+	}
+
 	if (request_pause) {
 		request_pause = false;
 
@@ -85,6 +114,15 @@ void EmulatorControl::process_events()
 	}
 }
 
+void EmulatorControl::stop_movie()
+{
+	if (movie.mode == MOVIE_RECORDING) {
+		movie.save(get_movie_path());
+	}
+
+	movie.stop();
+}
+
 void EmulatorControl::on_close()
 {
 	throttle_enabled = true;
@@ -110,6 +148,37 @@ void EmulatorControl::toggle_print_fps()
 	}
 }
 
+void EmulatorControl::cycle_run_ahead()
+{
+	int n = run_ahead_frames + 1;
+	if (n > 2) {
+		n = 0;
+	}
+	run_ahead_frames = n;
+
+	fprintf(stderr, "run-ahead: %d frame(s)\n", n);
+}
+
+void EmulatorControl::cycle_frame_skip()
+{
+	int n = render_interval + 1;
+	if (n > MAX_RENDER_INTERVAL) {
+		n = 1;
+	}
+	render_interval = n;
+
+	fprintf(stderr, "rendering every %d frame(s)\n", n);
+}
+
+int EmulatorControl::current_render_interval()
+{
+	if (throttle_enabled) {
+		return render_interval;
+	} else {
+		return fast_forward_render_interval;
+	}
+}
+
 std::string get_data_dir()
 {
 	char *t;
@@ -176,6 +245,25 @@ int find_bios_file(std::string &s)
 	}
 }
 
+/* looks for a bios in the working directory first, then in the data directory */
+int locate_bios_file(std::string &s)
+{
+	for (const char **fn = bios_filenames; *fn; fn++) {
+		std::ifstream f(*fn);
+		if (f.good()) {
+			s = std::string(*fn);
+			return 0;
+		}
+	}
+
+	return find_bios_file(s);
+}
+
+std::string get_movie_path()
+{
+	return cartridge.filename + ".flaremovie";
+}
+
 void copy_bios_file(std::string &s)
 {
 	std::string data_dir = get_data_dir();
@@ -203,3 +291,34 @@ void update_joypad(joypad_buttons button, bool down)
 	}
 }
 
+void publish_frame()
+{
+	shared.frames.publish();
+	framebuffer = shared.frames.back();
+}
+
+/*
+ * Dynamic rate control. The APU's blip buffer already resamples the GBA's
+ * output to the host rate with a windowed sinc, so keeping the audio queue
+ * from drifting only takes a small change to that rate: a fuller queue makes
+ * the next frame a little shorter, an emptier one a little longer.
+ */
+u32 adjusted_sample_rate()
+{
+	double fill = (double)shared.audio.size() / AUDIO_TARGET_FILL;
+	double error = std::clamp(fill - 1.0, -1.0, 1.0);
+
+	return std::lround(SAMPLE_RATE * (1.0 - error * AUDIO_MAX_RATE_ADJUST / 1e6));
+}
+
+/*
+ * Blocks until the audio device has played enough of the queue to take
+ * another frame. Waiting for half a frame below the target keeps the average
+ * fill at the target, where rate control leaves the rate alone.
+ */
+void wait_for_audio()
+{
+	while (emu_cnt.emulator_running && emu_cnt.audio_sync && shared.audio.size() > AUDIO_TARGET_FILL - SAMPLES_PER_FRAME / 2) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
@@ -0,0 +1,280 @@
+#include <platform/common/platform.h>
+#include <gba/emulator.h>
+#include <gba/memory.h>
+#include <gba/movie.h>
+#include <gba/ppu.h>
+#include <platform/common/capture.h>
+#include <platform/common/filter.h>
+#include <common/hash.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+/*
+ * Runs the emulator without a frontend and without frame pacing. Used to
+ * record and replay input movies, to check output against golden hash
+ * streams and to measure emulation speed.
+ */
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: %s-headless [options] ROM\n"
+		"  --bios FILE     bios file (default: searched like the Qt frontend)\n"
+		"  --hle-bios      service BIOS calls natively, runs without a bios file\n"
+		"  --frames N      number of frames to run (default: movie length, or 3600)\n"
+		"  --record FILE   record an input movie to FILE\n"
+		"  --replay FILE   replay movie FILE and verify its output hashes\n"
+		"  --hashes FILE   write the output hash stream to FILE (- for stdout)\n"
+		"  --hash-interval N  hash every N frames together into one checkpoint (default: 1)\n"
+		"  --golden FILE   compare the output hash stream against FILE\n"
+		"  --capture-video FILE  write every frame to FILE as Y4M\n"
+		"  --capture-audio FILE  write the audio to FILE as WAV\n"
+		"  --filter NAME   upscale captured video: nearest2x, nearest3x, scale2x, scale3x or xbr2x\n"
+		"  --output-format F  framebuffer format: bgr555 (default), rgb565 or xrgb8888\n"
+		"  --color-correction  approximate the colors of the GBA's LCD\n"
+		"  --no-save       do not write the cartridge save file on exit\n",
+		prog_name.c_str());
+}
+
+/* filter names without their spaces, so they can be given on the command line */
+static int find_filter(const std::string &name)
+{
+	for (int i = 0; i < NUM_FILTERS; i++) {
+		std::string s = filter_names[i];
+		s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+		if (s == name) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* a golden file is a hash stream written by --hashes, one hex hash per line */
+static bool read_golden(const std::string &filename, std::vector<u64> &golden)
+{
+	std::ifstream f(filename);
+	if (!f.good()) {
+		fprintf(stderr, "could not open %s\n", filename.c_str());
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(f, line)) {
+		if (line.length() > 0) {
+			golden.push_back(std::strtoull(line.c_str(), nullptr, 16));
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string record_file;
+	std::string replay_file;
+	std::string hashes_file;
+	std::string golden_file;
+	long hash_interval = 1;
+	std::string capture_video_file;
+	std::string capture_audio_file;
+	long frames = -1;
+	int format = OUTPUT_BGR555;
+	bool color_correction = false;
+	int filter_type = FILTER_NONE;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--bios" && has_value) {
+			args.bios_filename = argv[++i];
+		} else if (a == "--hle-bios") {
+			args.hle_bios = true;
+		} else if (a == "--frames" && has_value) {
+			frames = std::strtol(argv[++i], nullptr, 10);
+		} else if (a == "--record" && has_value) {
+			record_file = argv[++i];
+		} else if (a == "--replay" && has_value) {
+			replay_file = argv[++i];
+		} else if (a == "--hashes" && has_value) {
+			hashes_file = argv[++i];
+		} else if (a == "--hash-interval" && has_value) {
+			hash_interval = std::max(std::strtol(argv[++i], nullptr, 10), 1l);
+		} else if (a == "--golden" && has_value) {
+			golden_file = argv[++i];
+		} else if (a == "--capture-video" && has_value) {
+			capture_video_file = argv[++i];
+		} else if (a == "--capture-audio" && has_value) {
+			capture_audio_file = argv[++i];
+		} else if (a == "--output-format" && has_value) {
+			std::string f = argv[++i];
+			if (f == "bgr555") {
+				format = OUTPUT_BGR555;
+			} else if (f == "rgb565") {
+				format = OUTPUT_RGB565;
+			} else if (f == "xrgb8888") {
+				format = OUTPUT_XRGB8888;
+			} else {
+				usage();
+				return 2;
+			}
+		} else if (a == "--filter" && has_value) {
+			filter_type = find_filter(argv[++i]);
+			if (filter_type < 0) {
+				usage();
+				return 2;
+			}
+		} else if (a == "--color-correction") {
+			color_correction = true;
+		} else if (a == "--no-save") {
+			args.write_saves = false;
+		} else if (a.size() > 0 && a[0] != '-' && args.cartridge_filename.empty()) {
+			args.cartridge_filename = a;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (args.cartridge_filename.empty()) {
+		usage();
+		return 2;
+	}
+
+	if (args.bios_filename.empty() && locate_bios_file(args.bios_filename) && !args.hle_bios) {
+		fprintf(stderr, "could not find a bios file, use --bios\n");
+		return 2;
+	}
+
+	FILE *hashes = nullptr;
+	if (hashes_file == "-") {
+		hashes = stdout;
+	} else if (hashes_file.length() > 0) {
+		hashes = std::fopen(hashes_file.c_str(), "w");
+		if (!hashes) {
+			fprintf(stderr, "could not open %s\n", hashes_file.c_str());
+			return 2;
+		}
+	}
+
+	std::vector<u64> golden;
+	if (golden_file.length() > 0 && !read_golden(golden_file, golden)) {
+		return 2;
+	}
+
+	/* the filters work on XRGB8888 */
+	if (filter_type != FILTER_NONE) {
+		format = OUTPUT_XRGB8888;
+	}
+	set_output_format(format, color_correction);
+
+	Filter filter(filter_type == FILTER_NONE ? 1 : std::min(std::thread::hardware_concurrency(), 4u));
+	filter.set_type(filter_type);
+	std::vector<u32> filtered(FRAMEBUFFER_SIZE * filter.scale() * filter.scale());
+
+	try {
+		if (!args.bios_filename.empty()) {
+			load_bios_rom(args.bios_filename);
+		}
+		emu.init(args);
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+
+	if (replay_file.length() > 0) {
+		if (!movie.load(replay_file) || !movie.start_playback()) {
+			return 2;
+		}
+		if (frames < 0) {
+			frames = movie.frames.size();
+		}
+	} else if (record_file.length() > 0) {
+		movie.start_recording();
+	}
+
+	if (frames < 0) {
+		frames = 3600;
+	}
+
+	if (capture_video_file.length() > 0 || capture_audio_file.length() > 0) {
+		if (!capture.start(capture_video_file, capture_audio_file, filter.scale())) {
+			return 2;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	u64 checkpoint = 0;
+	std::size_t checkpoints = 0;
+	std::size_t golden_mismatches = 0;
+	bool hashing = hashes || golden_file.length() > 0;
+
+	for (long i = 0; i < frames; i++) {
+		emu.run_frame();
+
+		if (hashing) {
+			u64 h = hash_frame_output(emu.frame_rendered);
+			checkpoint = hash_interval == 1 ? h : xxhash64(&h, sizeof(h), checkpoint);
+
+			if ((i + 1) % hash_interval == 0 || i + 1 == frames) {
+				if (hashes) {
+					fprintf(hashes, "%016llx\n", (unsigned long long)checkpoint);
+				}
+
+				if (golden_file.length() > 0 && (checkpoints >= golden.size() || golden[checkpoints] != checkpoint)) {
+					if (golden_mismatches == 0) {
+						fprintf(stderr, "golden: output differs at checkpoint %zu (frame %ld)\n", checkpoints, i);
+					}
+					golden_mismatches++;
+				}
+
+				checkpoints++;
+				checkpoint = 0;
+			}
+		}
+
+		const u32 *pixels = emu.frame_rendered ? framebuffer : nullptr;
+		if (pixels && filter_type != FILTER_NONE && capture.active()) {
+			filter.apply(pixels, filtered.data());
+			pixels = filtered.data();
+		}
+		capture.push(pixels, output_format, audiobuffer, emu.audio_samples);
+	}
+
+	capture.stop();
+
+	std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+
+	if (hashes && hashes != stdout) {
+		std::fclose(hashes);
+	}
+
+	if (golden_file.length() > 0) {
+		if (checkpoints != golden.size()) {
+			fprintf(stderr, "golden: %zu checkpoints, %s has %zu\n", checkpoints, golden_file.c_str(), golden.size());
+		}
+		fprintf(stderr, "golden: %zu of %zu checkpoints differ\n", golden_mismatches, checkpoints);
+	}
+
+	bool failed = movie.mismatches > 0 || golden_mismatches > 0 || (golden_file.length() > 0 && checkpoints != golden.size());
+	if (movie.mode == MOVIE_RECORDING) {
+		movie.save(record_file);
+	}
+
+	fprintf(stderr, "ran %ld frames in %.3f s (%.1f fps)\n", frames, sec.count(), frames / sec.count());
+
+	emu.quit();
+
+	return failed ? 1 : 0;
+}
@@ -18,18 +18,7 @@ int main(int argc, char *argv[])
 
 	fprintf(stderr, "GBAFLare - Gameboy Advance Emulator\n");
 
-	const char **fn;
-	for (fn = bios_filenames; *fn; fn++) {
-		std::ifstream f(*fn);
-		if (f.good()) {
-			break;
-		}
-	}
-	if (*fn) {
-		args.bios_filename = std::string(*fn);
-	} else {
-		find_bios_file(args.bios_filename);
-	}
+	locate_bios_file(args.bios_filename);
 
 	shared.bios_filename = args.bios_filename;
 	if (args.bios_filename.length() > 0) {
@@ -1,25 +1,58 @@
 #include <platform/qt/mainwindow.h>
 #include <platform/common/platform.h>
+#include <platform/common/pacer.h>
 #include <gba/emulator.h>
+#include <gba/ppu.h>
 #include "./ui_mainwindow.h"
 
 #include <QImage>
-#include <QPixmap>
+#include <QPainter>
 #include <QKeyEvent>
 #include <QFileDialog>
 
+#include <algorithm>
+
+ScreenItem::ScreenItem()
+	: image(LCD_WIDTH, LCD_HEIGHT, QImage::Format_RGB32)
+{
+	image.fill(Qt::black);
+}
+
+/* wraps an XRGB8888 frame, scale times the size of the LCD, without copying it */
+void ScreenItem::set_frame(u32 *pixels, int scale)
+{
+	image = QImage((uchar *)pixels, LCD_WIDTH * scale, LCD_HEIGHT * scale, QImage::Format_RGB32);
+	update();
+}
+
+QRectF ScreenItem::boundingRect() const
+{
+	return QRectF(0, 0, LCD_WIDTH, LCD_HEIGHT);
+}
+
+void ScreenItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *)
+{
+	painter->drawImage(boundingRect(), image);
+}
+
 MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
+	, filter(std::min(std::thread::hardware_concurrency(), 4u))
 	, ui(new Ui::MainWindow)
 {
 	ui->setupUi(this);
 
 	ui->graphicsView->installEventFilter(this);
 
+	set_output_format(OUTPUT_XRGB8888, false);
+
 	scene = new QGraphicsScene(this);
 	scene->setBackgroundBrush(Qt::black);
+	screen = new ScreenItem;
+	scene->addItem(screen);
+	scene->setSceneRect(screen->boundingRect());
 	ui->graphicsView->setScene(scene);
-	render(shared.framebuffer);
+	render(shared.frames.front());
 
 	QAudioFormat format;
 	format.setSampleRate(SAMPLE_RATE);
@@ -40,7 +73,11 @@ MainWindow::MainWindow(QWidget *parent)
 #else
 	audio->setBufferSize(12000);
 #endif
-	qbuffer = audio->start();
+	connect(audio, SIGNAL(stateChanged(QAudio::State)), SLOT(onAudioStateChanged(QAudio::State)));
+
+	audio_source = new AudioSource(this);
+	audio_source->open(QIODevice::ReadOnly);
+	audio->start(audio_source);
 
 	emu_thread = new EmulatorThread;
 	connect(emu_thread, SIGNAL(endOfFrame()), SLOT(onEndOfFrame()));
@@ -54,6 +91,7 @@ MainWindow::~MainWindow()
 
 	delete emu_thread;
 	delete audio;
+	delete audio_source;
 	delete scene;
 	delete ui;
 }
@@ -63,12 +101,24 @@ void MainWindow::scale_view()
 	ui->graphicsView->fitInView(scene->sceneRect(), Qt::KeepAspectRatio);
 }
 
-void MainWindow::render(u16 *pixels)
+void MainWindow::render(u32 *pixels)
 {
-	ui->graphicsView->scene()->clear();
-	QImage image = QImage((unsigned char*)pixels, LCD_WIDTH, LCD_HEIGHT, QImage::Format_RGB555).rgbSwapped();
-	QPixmap pixmap = QPixmap::fromImage(image);
-	ui->graphicsView->scene()->addPixmap(pixmap);
+	if (filter.type == FILTER_NONE) {
+		screen->set_frame(pixels, 1);
+		return;
+	}
+
+	filtered.resize(FRAMEBUFFER_SIZE * filter.scale() * filter.scale());
+	filter.apply(pixels, filtered.data());
+	screen->set_frame(filtered.data(), filter.scale());
+}
+
+void MainWindow::cycle_filter()
+{
+	filter.set_type((filter.type + 1) % NUM_FILTERS);
+	fprintf(stderr, "filter: %s\n", filter_names[filter.type]);
+
+	render(shared.frames.front());
 }
 
 void MainWindow::resizeEvent(QResizeEvent *event)
@@ -100,15 +150,43 @@ void MainWindow::onEndOfFrame()
 		return;
 	}
 
-	int state = emu_cnt.emulator_state;
-	shared.lock.lock();
-	render(shared.framebuffer);
-	if (state == EMULATION_RUNNING && emu_cnt.throttle_enabled) {
-		qbuffer->write((const char *)shared.audiobuffer, SAMPLES_PER_FRAME * sizeof(*shared.audiobuffer));
+	if (shared.frames.acquire()) {
+		render(shared.frames.front());
 	}
-	shared.lock.unlock();
 };
 
+/* the emulator thread paces itself on the audio device only while it is actually playing */
+void MainWindow::onAudioStateChanged(QAudio::State state)
+{
+	emu_cnt.audio_sync = audio->error() == QAudio::NoError && (state == QAudio::ActiveState || state == QAudio::IdleState);
+}
+
+AudioSource::AudioSource(QObject *parent)
+	: QIODevice(parent)
+{
+}
+
+qint64 AudioSource::readData(char *data, qint64 maxlen)
+{
+	s16 *samples = (s16 *)data;
+	std::size_t n = maxlen / sizeof(s16) & ~(std::size_t)1;
+
+	std::size_t got = shared.audio.pop(samples, n);
+	std::fill(samples + got, samples + n, 0);
+
+	return n * sizeof(s16);
+}
+
+qint64 AudioSource::writeData(const char *, qint64)
+{
+	return -1;
+}
+
+qint64 AudioSource::bytesAvailable() const
+{
+	return shared.audio.size() * sizeof(s16) + QIODevice::bytesAvailable();
+}
+
 void MainWindow::onSignalUI(float fps)
 {
 	int state = emu_cnt.emulator_state;
@@ -153,6 +231,24 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
 	case Qt::Key_P:
 		emu_cnt.toggle_print_fps();
 		return;
+	case Qt::Key_R:
+		emu_cnt.cycle_run_ahead();
+		return;
+	case Qt::Key_K:
+		emu_cnt.cycle_frame_skip();
+		return;
+	case Qt::Key_C:
+		emu_cnt.color_correction = !emu_cnt.color_correction;
+		return;
+	case Qt::Key_G:
+		cycle_filter();
+		return;
+	case Qt::Key_F8:
+		emu_cnt.request_record = true;
+		return;
+	case Qt::Key_F9:
+		emu_cnt.request_playback = true;
+		return;
 	case Qt::Key_Escape:
 		emu_cnt.request_pause = true;
 		return;
@@ -308,7 +404,10 @@ void MainWindow::onToolbarFastForward(bool checked)
 void EmulatorThread::run()
 {
 	auto tick_start = std::chrono::steady_clock::now();
-	std::chrono::duration<double> frame_duration(1.0 / FPS);
+	auto stats_start = tick_start;
+
+	FramePacer pacer;
+	pacer.set_rate(FPS);
 
 	for (;;) {
 		if (!emu_cnt.emulator_running) {
@@ -319,18 +418,23 @@ void EmulatorThread::run()
 			//emit endOfFrame();
 			emu_cnt.process_events();
 		} else if (emu_cnt.emulator_state == EMULATION_RUNNING) {
-			emu.run_one_frame();
-			shared.lock.lock();
-			std::memcpy(shared.framebuffer, framebuffer, FRAMEBUFFER_SIZE * sizeof(*framebuffer));
-			std::memcpy(shared.audiobuffer, audiobuffer, AUDIOBUFFER_SIZE * sizeof(*audiobuffer));
-			shared.lock.unlock();
+			emu.set_render_interval(emu_cnt.current_render_interval());
+			emu.set_sample_rate(adjusted_sample_rate());
+			if (emu_cnt.color_correction != output_color_correction) {
+				set_output_format(output_format, emu_cnt.color_correction);
+			}
+			emu.run_frame();
+			if (emu.frame_rendered) {
+				publish_frame();
+			}
+			if (emu_cnt.throttle_enabled) {
+				shared.audio.push(audiobuffer, emu.audio_samples);
+			}
 			//emit endOfFrame();
 			emu_cnt.process_events();
 		} else {
-			shared.lock.lock();
-			ZERO_ARR(shared.framebuffer);
-			ZERO_ARR(shared.audiobuffer);
-			shared.lock.unlock();
+			std::fill_n(framebuffer, FRAMEBUFFER_SIZE, 0);
+			publish_frame();
 			//emit endOfFrame();
 			emu_cnt.process_events();
 		}
@@ -339,11 +443,22 @@ void EmulatorThread::run()
 		double fps = 1 / sec.count();
 		if (emu_cnt.print_fps) {
 			fprintf(stderr, "fps: %f\n", fps);
+
+			if (tick_start - stats_start >= std::chrono::seconds(1)) {
+				pacer.print_stats();
+				pacer.reset_stats();
+				stats_start = tick_start;
+			}
 		}
 
-		if (emu_cnt.throttle_enabled || emu_cnt.emulator_state != EMULATION_RUNNING) {
-			while (std::chrono::steady_clock::now() - tick_start < frame_duration)
-				;
+		/* while audio plays, the device's consumption paces emulation; otherwise the clock does */
+		if (emu_cnt.throttle_enabled && emu_cnt.emulator_state == EMULATION_RUNNING && emu_cnt.audio_sync) {
+			wait_for_audio();
+			pacer.restart();
+		} else if (emu_cnt.throttle_enabled || emu_cnt.emulator_state != EMULATION_RUNNING) {
+			pacer.wait();
+		} else {
+			pacer.restart();
 		}
 		tick_start = std::chrono::steady_clock::now();
 
@@ -351,5 +466,6 @@ void EmulatorThread::run()
 		emit signalUI(fps);
 	}
 
+	emu_cnt.stop_movie();
 	emu.quit();
 }